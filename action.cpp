@@ -18,11 +18,13 @@
 
 #include "action.hpp"
 #include "pathfinding.hpp"
+#include "budgeted_search.hpp"
 #include "constants.h"
 #include <iostream>
 #include <algorithm>
 #include "factorio_io.h"
 #include <climits>
+#include <cmath>
 #include "logging.hpp"
 
 using namespace std;
@@ -79,9 +81,42 @@ namespace action {
 
 	void WalkTo::start()
 	{
-		std::vector<Pos> waypoints = a_star(game->players[player].position.to_int(), destination, game->walk_map, allowed_distance, min_distance);
-		subactions.push_back(unique_ptr<ActionBase>(new WalkWaypoints(game,player,nullopt, waypoints)));
+		search = make_shared<pathfinding::BudgetedSearch>(game->pathfinder.start_search(game->players[player].position.to_int(), destination, allowed_distance, min_distance));
+		continue_search();
+	}
+
+	void WalkTo::tick()
+	{
+		if (search)
+			continue_search();
+		else
+			CompoundAction::tick();
+	}
+
+	void WalkTo::continue_search()
+	{
+		if (search->run_for(SEARCH_BUDGET) == pathfinding::BudgetedSearch::status_t::RUNNING)
+			return;
 
+		std::vector<Pos> waypoints = search->path();
+		bool walkable = search->still_walkable();
+		search = nullptr;
+		if (waypoints.empty())
+		{
+			Logger log("action");
+			log << "WalkTo " << destination.str() << ": there is no path, giving up" << endl;
+			return;
+		}
+		if (!walkable)
+		{
+			// the map has changed while the search was running
+			Logger log("action");
+			log << "WalkTo " << destination.str() << ": the path has been blocked in the meantime, searching again" << endl;
+			start();
+			return;
+		}
+
+		subactions.push_back(unique_ptr<ActionBase>(new WalkWaypoints(game,player,nullopt, waypoints)));
 		registry.start_action(subactions[0]);
 	}
 
@@ -130,7 +165,10 @@ namespace action {
 	std::pair<Pos, Clock::duration> WalkTo::walk_result(Pos current_position) const
 	{
 		// TODO FIXME: if we've a detailed path, return that one
-		return pair(destination.center(), chrono::milliseconds( int(1000*(current_position - destination.center()).len() / WALKING_SPEED) ));
+		double length = game->pathfinder.travel_distance(current_position, destination, allowed_distance);
+		if (!std::isfinite(length))
+			length = (current_position - destination.center()).len();
+		return pair(destination.center(), chrono::milliseconds( int(1000*length / WALKING_SPEED) ));
 	}
 
 	std::pair<Pos, Clock::duration> WalkWaypoints::walk_result(Pos current_position) const
@@ -143,7 +181,7 @@ namespace action {
 		{
 			const Pos& from = waypoints[i];
 			const Pos& to = waypoints[i+1];
-			seconds += float((from-to).len() / WALKING_SPEED);
+			seconds += float(pathfinding::octile_distance(from, to) / WALKING_SPEED);
 		}
 
 		return pair(waypoints.back(), chrono::milliseconds(int(1000*seconds)));
@@ -33,6 +33,7 @@
 #include "clock.hpp"
 
 class FactorioGame;
+namespace pathfinding { class BudgetedSearch; }
 
 namespace action
 {
@@ -177,12 +178,23 @@ namespace action
 			return destination.center();
 		}
 
+		/** how long the path search may take per tick() */
+		static constexpr Clock::duration SEARCH_BUDGET = std::chrono::milliseconds(2);
+
 		WalkTo(FactorioGame* game_, int player_, Area_f destination_, double allowed_distance_ = 1., double min_distance_ = 0.) { game = game_; player = player_; destination = destination_; allowed_distance = allowed_distance_; min_distance = min_distance_; }
 		[[deprecated]] WalkTo(FactorioGame* game_, int player_, Pos destination_, double allowed_distance_ = 1.) : WalkTo(game_, player_, Area_f(destination_,destination_), allowed_distance_) {}
 		private: void start(); public: // FIXME ugly
 
+		void tick();
+		bool is_finished() const { return search == nullptr && CompoundAction::is_finished(); }
+
 		
 		std::pair<Pos, Clock::duration> walk_result(Pos current_position) const; // TODO FIXME implement
+
+		private:
+			// the path search in progress. Long searches are spread over several ticks.
+			std::shared_ptr<pathfinding::BudgetedSearch> search;
+			void continue_search();
 	};
 
 	// TODO: primitive action list
@@ -17,24 +17,34 @@
  */
 
 #include <string>
-#include <cstdio>
+#include <string_view>
 #include "area.hpp"
+#include "split.hpp"
 
 using std::string;
-using std::sscanf;
+using std::string_view;
 using std::min;
 using std::abs;
 
+template <typename T>
+static Area_<T> parse_area(string_view str)
+{
+	auto [left_top, right_bottom] = unpack<string_view,string_view>(str, ';');
+	auto [x1, y1] = unpack<T,T>(left_top, ',');
+	auto [x2, y2] = unpack<T,T>(right_bottom, ',');
+	return Area_<T>(x1,y1,x2,y2);
+}
+
 template <>
-Area_<int>::Area_(string str)
+Area_<int>::Area_(string_view str)
 {
-	sscanf(str.c_str(), "%i,%i;%i,%i", &left_top.x, &left_top.y, &right_bottom.x, &right_bottom.y);
+	*this = parse_area<int>(str);
 }
 
 template <>
-Area_<double>::Area_(string str)
+Area_<double>::Area_(string_view str)
 {
-	sscanf(str.c_str(), "%lf,%lf;%lf,%lf", &left_top.x, &left_top.y, &right_bottom.x, &right_bottom.y);
+	*this = parse_area<double>(str);
 }
 
 template <typename T>
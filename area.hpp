@@ -19,6 +19,7 @@
 #pragma once
 #include <type_traits>
 #include <string>
+#include <string_view>
 #include <cmath>
 #include <algorithm>
 #include "pos.hpp"
@@ -52,7 +53,7 @@ template<typename T> struct Area_
 				right_bottom.y = p.y+1;
 		}
 	}
-	Area_(std::string str);
+	Area_(std::string_view str);
 	template <typename U> Area_(const Area_<U>& other) : left_top(other.left_top), right_bottom(other.right_bottom) {}
 	
 	std::string str() const;
@@ -134,8 +135,8 @@ template<typename T> struct Area_
 typedef Area_<int> Area;
 typedef Area_<double> Area_f;
 
-template <> Area_<int>::Area_(std::string str);
-template <> Area_<double>::Area_(std::string str);
+template <> Area_<int>::Area_(std::string_view str);
+template <> Area_<double>::Area_(std::string_view str);
 extern template struct Area_<int>;
 extern template struct Area_<double>;
 
@@ -0,0 +1,180 @@
+/*
+ * Copyright (c) 2017, 2018 Florian Jung
+ *
+ * This file is part of factorio-bot.
+ *
+ * factorio-bot is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License,
+ * version 3, as published by the Free Software Foundation.
+ *
+ * factorio-bot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with factorio-bot. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cmath>
+#include <algorithm>
+
+#include "budgeted_search.hpp"
+#include "components.hpp"
+#include "logging.hpp"
+
+using namespace std;
+using namespace pathfinding;
+
+static const Pos STEPS[] = {Pos(-1,-1), Pos(0, -1), Pos(1,-1),
+                            Pos(-1, 0),             Pos(1, 0),
+                            Pos(-1, 1), Pos(0,  1), Pos(1, 1)};
+
+BudgetedSearch::BudgetedSearch(const WorldMap<walk_t>& map_, const Pos& start_, const Area_f& end_, double allowed_distance_, double min_distance_, double length_limit_, double size_, const Components* components)
+	: map(&map_), start(start_), end(end_), allowed_distance(allowed_distance_), min_distance(min_distance_), length_limit(length_limit_), size(size_)
+{
+	Logger log("pathfinding");
+	log << "budgeted search from " << start.str() << " to " << end.str() << " (allowed_distance=" << allowed_distance << ", min_distance=" << min_distance << ", length_limit=" << length_limit << ", size=" << size << ")" << endl;
+
+	if (ceil(min_distance) >= allowed_distance)
+		throw invalid_argument("ceil(min_distance) must be smaller than allowed distance");
+	assert(size<=1.);
+
+	closest = start;
+	closest_h = heuristic(start);
+
+	if (components && size >= Components::SIZE && !components->may_reach(map_, start, end, allowed_distance))
+	{
+		log << "the goal is in another region than the start" << endl;
+		state = status_t::NO_PATH;
+		return;
+	}
+
+	search.reset();
+	search.at(start).g_val = 0.;
+	search.at(start).opened = true;
+	openlist.push(Entry(start, closest_h));
+}
+
+BudgetedSearch::BudgetedSearch(const WorldMap<walk_t>& map_, const vector<Pos>& path, double size_)
+	: map(&map_), start(path.empty() ? Pos() : path.front()), end(), allowed_distance(1.), min_distance(0.), length_limit(0.), size(size_),
+	  state(path.empty() ? status_t::NO_PATH : status_t::FOUND), result(path), closest(start), closest_h(0.)
+{
+}
+
+BudgetedSearch BudgetedSearch::finished(const WorldMap<walk_t>& map, const vector<Pos>& path, double size)
+{
+	return BudgetedSearch(map, path, size);
+}
+
+BudgetedSearch::status_t BudgetedSearch::run_for(Clock::duration budget)
+{
+	auto deadline = Clock::now() + budget;
+	while (run(CLOCK_INTERVAL) == status_t::RUNNING)
+		if (Clock::now() >= deadline)
+			break;
+	return state;
+}
+
+BudgetedSearch::status_t BudgetedSearch::run(size_t max_expansions)
+{
+	if (state != status_t::RUNNING)
+		return state;
+
+	auto view = map->dumb_view(Pos(0,0));
+
+	for (size_t i = 0; i < max_expansions; i++)
+	{
+		if (openlist.empty())
+		{
+			state = status_t::NO_PATH;
+			break;
+		}
+
+		Entry current = openlist.top();
+		openlist.pop();
+		search_t& current_state = search.at(current.pos);
+		if (current_state.in_closedlist)
+			continue; // outdated entry
+
+		// the heuristic is a lower bound, so this (and any subsequent) entry exceeds the length_limit
+		if (current.f > length_limit)
+		{
+			state = status_t::NO_PATH;
+			break;
+		}
+
+		current_state.in_closedlist = true;
+		n_expansions++;
+
+		double h = heuristic(current.pos);
+		if (h < closest_h)
+		{
+			closest = current.pos;
+			closest_h = h;
+		}
+
+		double dist = distance(current.pos, end);
+		if (dist <= allowed_distance && dist >= min_distance)
+		{
+			result = smooth_path(path_to(current.pos), *map, size);
+			state = status_t::FOUND;
+			break;
+		}
+
+		double g_val = current_state.g_val;
+		for (const Pos& step : STEPS)
+		{
+			if (!can_step(view, current.pos, step, size))
+				continue;
+
+			Pos successor = current.pos + step;
+			search_t& succ = search.at(successor);
+			if (succ.in_closedlist)
+				continue;
+
+			double new_g = g_val + step.len();
+			if (succ.opened && succ.g_val <= new_g)
+				continue;
+
+			succ.predecessor = current.pos;
+			succ.g_val = new_g;
+			succ.opened = true;
+			openlist.push(Entry(successor, new_g + heuristic(successor)));
+		}
+	}
+
+	if (state != status_t::RUNNING)
+	{
+		Logger log("pathfinding");
+		log << "budgeted search from " << start.str() << " to " << end.str() << (state == status_t::FOUND ? " found a path" : " failed") << " after " << n_expansions << " iterations" << endl;
+	}
+	return state;
+}
+
+bool BudgetedSearch::still_walkable() const
+{
+	auto view = map->dumb_view(Pos(0,0));
+	for (size_t i = 1; i < result.size(); i++)
+		if (!can_walk_octile(view, result[i-1], result[i], size))
+			return false;
+	return true;
+}
+
+vector<Pos> BudgetedSearch::path_to(const Pos& pos) const
+{
+	vector<Pos> path;
+	for (Pos p = pos; p != start; p = search.at(p).predecessor)
+		path.push_back(p);
+	path.push_back(start);
+	reverse(path.begin(), path.end());
+	return path;
+}
+
+vector<Pos> BudgetedSearch::partial_path() const
+{
+	if (state == status_t::FOUND)
+		return result;
+	if (n_expansions == 0)
+		return {};
+	return path_to(closest);
+}
@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2017, 2018 Florian Jung
+ *
+ * This file is part of factorio-bot.
+ *
+ * factorio-bot is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License,
+ * version 3, as published by the Free Software Foundation.
+ *
+ * factorio-bot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with factorio-bot. If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <vector>
+#include <limits>
+
+#include "pathfinding.hpp"
+#include "dary_heap.hpp"
+#include "worldmap.hpp"
+#include "clock.hpp"
+#include "pos.hpp"
+#include "area.hpp"
+
+namespace pathfinding
+{
+	class Components;
+
+	/** An A* search like a_star() that runs only a bit at a time, so that the main loop does not
+	  * block on long or hopeless queries. Call run() or run_for() again until it is done. In the
+	  * meantime, partial_path() leads to the vertex that came closest to the goal so far.
+	  *
+	  * The heuristic is the exact direct line, so the path is a shortest one. Every search has
+	  * its own state, so any number of them can be in progress at once. The map may change while
+	  * the search is running, but the vertices that have been expanded before are not looked at
+	  * again. The path may then lead through tiles that have been blocked since, which
+	  * still_walkable() tells.
+	  */
+	class BudgetedSearch
+	{
+		public:
+			enum class status_t { RUNNING, FOUND, NO_PATH };
+
+			/** vertices that are expanded between two looks at the clock in run_for() */
+			static constexpr size_t CLOCK_INTERVAL = 256;
+
+			/** If `components` is given and says that the goal can not be reached from the start,
+			  * the search fails right away. */
+			BudgetedSearch(const WorldMap<walk_t>& map, const Pos& start, const Area_f& end, double allowed_distance=1., double min_distance=0., double length_limit=std::numeric_limits<double>::infinity(), double size=0.5, const Components* components=nullptr);
+
+			/** a search that has already finished with `path`, or with no path if it is empty */
+			static BudgetedSearch finished(const WorldMap<walk_t>& map, const std::vector<Pos>& path, double size=0.5);
+
+			/** expands at most `max_expansions` more vertices */
+			status_t run(size_t max_expansions);
+			/** runs for about `budget` */
+			status_t run_for(Clock::duration budget);
+
+			status_t status() const { return state; }
+			bool done() const { return state != status_t::RUNNING; }
+			size_t expansions() const { return n_expansions; }
+
+			/** the path like a_star() returns it, or an empty one if the search is still
+			  * running or has failed */
+			const std::vector<Pos>& path() const { return result; }
+			/** whether the path can still be walked on the map as it is now, see can_walk_octile() */
+			bool still_walkable() const;
+			/** the path to the vertex closest to the goal that has been expanded so far */
+			std::vector<Pos> partial_path() const;
+
+		private:
+			const WorldMap<walk_t>* map;
+			Pos start;
+			Area_f end;
+			double allowed_distance;
+			double min_distance;
+			double length_limit;
+			double size;
+
+			status_t state = status_t::RUNNING;
+			size_t n_expansions = 0;
+			std::vector<Pos> result;
+			Pos closest; // the expanded vertex with the smallest heuristic
+			double closest_h;
+
+			mutable SearchContext search;
+			DaryHeap<Entry> openlist;
+
+			BudgetedSearch(const WorldMap<walk_t>& map, const std::vector<Pos>& path, double size);
+
+			double heuristic(const Pos& pos) const { return std::max(0., distance(pos, end) - allowed_distance); }
+			std::vector<Pos> path_to(const Pos& pos) const;
+	};
+}
@@ -0,0 +1,293 @@
+/*
+ * Copyright (c) 2017, 2018 Florian Jung
+ *
+ * This file is part of factorio-bot.
+ *
+ * factorio-bot is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License,
+ * version 3, as published by the Free Software Foundation.
+ *
+ * factorio-bot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with factorio-bot. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <numeric>
+#include <limits>
+#include <utility>
+#include <algorithm>
+#include <tuple>
+
+#include "components.hpp"
+
+using namespace std;
+using namespace pathfinding;
+
+static const Pos STEPS[] = {Pos(-1,-1), Pos(0, -1), Pos(1,-1),
+                            Pos(-1, 0),             Pos(1, 0),
+                            Pos(-1, 1), Pos(0,  1), Pos(1, 1)};
+
+void Components::invalidate(const Area& area)
+{
+	// the steps from a vertex depend on the tiles around it
+	Pos lefttop = Pos::tile_to_chunk(area.left_top - Pos(2,2));
+	Pos rightbot = Pos::tile_to_chunk_ceil(area.right_bottom + Pos(2,2));
+
+	lock_guard<mutex> lock(chunks_mutex);
+	for (int x = lefttop.x; x < rightbot.x; x++)
+		for (int y = lefttop.y; y < rightbot.y; y++)
+		{
+			auto it = chunks.find(Pos(x,y));
+			if (it != chunks.end())
+				it->second->valid = false;
+		}
+}
+
+void Components::clear()
+{
+	lock_guard<mutex> lock(chunks_mutex);
+	chunks.clear();
+	first_index.clear();
+	parent.clear();
+	n_map_chunks = 0;
+	n_live_regions = 0;
+	joined = false;
+}
+
+bool Components::same_region(const WorldMap<walk_t>& map, const Pos& a, const Pos& b) const
+{
+	lock_guard<mutex> lock(chunks_mutex);
+	update(map);
+	return find(region_of(a)) == find(region_of(b));
+}
+
+bool Components::may_reach(const WorldMap<walk_t>& map, const Pos& start, const Area_f& end, double allowed_distance) const
+{
+	Area box = goal_box(end, allowed_distance);
+	if (box.size().x * box.size().y > MAX_GOAL_VERTICES)
+		return true;
+
+	lock_guard<mutex> lock(chunks_mutex);
+	update(map);
+	uint32_t region = find(region_of(start));
+	for (int x = box.left_top.x; x < box.right_bottom.x; x++)
+		for (int y = box.left_top.y; y < box.right_bottom.y; y++)
+			if (distance(Pos(x,y), end) <= allowed_distance && find(region_of(Pos(x,y))) == region)
+				return true;
+	return false;
+}
+
+uint32_t Components::find(uint32_t index) const
+{
+	uint32_t root = index;
+	while (parent[root] != root)
+		root = parent[root];
+	while (parent[index] != root)
+		index = exchange(parent[index], root);
+	return root;
+}
+
+uint32_t Components::region_of(const Pos& pos) const
+{
+	Pos chunkpos = Pos::tile_to_chunk(pos);
+	auto it = chunks.find(chunkpos);
+	if (it == chunks.end())
+		return 0;
+	return first_index.at(chunkpos) + it->second->labels[tileidx(pos.x)][tileidx(pos.y)];
+}
+
+void Components::update(const WorldMap<walk_t>& map) const
+{
+	if (map.n_chunks() != n_map_chunks)
+	{
+		map.for_each_chunk([&](const Pos& chunkpos, const auto&) {
+			if (chunks[chunkpos] == nullptr)
+				chunks[chunkpos] = make_unique<chunk_t>();
+		});
+		n_map_chunks = map.n_chunks();
+	}
+
+	// relabel the changed chunks, and check whether their old labels are merely joined by the new ones
+	struct change_t
+	{
+		Pos chunkpos;
+		bool is_new; // was unexplored until now
+		uint32_t old_first_index;
+		vector<label_t> new_label; // of each old label
+	};
+	vector<change_t> changes;
+	bool merge = joined;
+	for (auto& [chunkpos, chunk] : chunks)
+		if (!chunk->valid)
+		{
+			change_t change{chunkpos, chunk->n_labels == 0, 0, {}};
+			if (merge && change.is_new)
+			{
+				compute(map, chunkpos, *chunk);
+				merge = only_merges_new(*chunk);
+			}
+			else if (merge)
+			{
+				change.old_first_index = first_index.at(chunkpos);
+				chunk_t old_chunk = move(*chunk);
+				*chunk = chunk_t();
+				compute(map, chunkpos, *chunk);
+				merge = only_merges(old_chunk, *chunk, change.new_label);
+			}
+			else
+				compute(map, chunkpos, *chunk);
+
+			stats_.relabeled_chunks++;
+			changes.push_back(move(change));
+		}
+
+	if (changes.empty() && joined)
+		return;
+
+	// if too much of the union-find structure is outdated, compact it
+	if (!merge || parent.size() > 2*n_live_regions + 1024)
+	{
+		rebuild();
+		return;
+	}
+
+	for (change_t& change : changes)
+	{
+		const chunk_t& chunk = *chunks.at(change.chunkpos);
+		uint32_t first = parent.size();
+		parent.resize(first + chunk.n_labels);
+		iota(parent.begin() + first, parent.end(), first);
+		first_index[change.chunkpos] = first;
+		n_live_regions += chunk.n_labels;
+
+		// the old regions live on in the new ones
+		if (!change.is_new)
+		{
+			for (size_t label = 0; label < change.new_label.size(); label++)
+				unite(change.old_first_index + label, first + change.new_label[label]);
+			n_live_regions -= change.new_label.size();
+		}
+	}
+	for (const change_t& change : changes)
+		for (const auto& [label, outside] : chunks.at(change.chunkpos)->border_steps)
+			unite(first_index[change.chunkpos] + label, region_of(outside));
+	stats_.merges++;
+}
+
+void Components::rebuild() const
+{
+	uint32_t n_regions = 1;
+	for (const auto& [chunkpos, chunk] : chunks)
+	{
+		first_index[chunkpos] = n_regions;
+		n_regions += chunk->n_labels;
+	}
+	parent.resize(n_regions);
+	iota(parent.begin(), parent.end(), 0);
+	n_live_regions = n_regions;
+
+	for (const auto& [chunkpos, chunk] : chunks)
+		for (const auto& [label, outside] : chunk->border_steps)
+			unite(first_index[chunkpos] + label, region_of(outside));
+	joined = true;
+	stats_.rebuilds++;
+}
+
+void Components::unite(uint32_t a, uint32_t b) const
+{
+	a = find(a);
+	b = find(b);
+	if (a != b)
+		parent[max(a,b)] = min(a,b); // keeps the unexplored region at index 0 as the root
+}
+
+bool Components::only_merges(const chunk_t& old_chunk, const chunk_t& chunk, vector<label_t>& new_label) const
+{
+	// every old region must lie within one new region, ...
+	const label_t UNSET = numeric_limits<label_t>::max();
+	new_label.assign(old_chunk.n_labels, UNSET);
+	for (int x = 0; x < 32; x++)
+		for (int y = 0; y < 32; y++)
+		{
+			label_t& label = new_label[old_chunk.labels[x][y]];
+			if (label == UNSET)
+				label = chunk.labels[x][y];
+			else if (label != chunk.labels[x][y])
+				return false;
+		}
+
+	// ... and must still have all its steps out of the chunk
+	auto less = [](const pair<label_t,Pos>& a, const pair<label_t,Pos>& b) {
+		return tie(a.second.x, a.second.y, a.first) < tie(b.second.x, b.second.y, b.first);
+	};
+	vector< pair<label_t,Pos> > steps = chunk.border_steps;
+	sort(steps.begin(), steps.end(), less);
+	for (const auto& [label, outside] : old_chunk.border_steps)
+		if (!binary_search(steps.begin(), steps.end(), pair(new_label[label], outside), less))
+			return false;
+	return true;
+}
+
+bool Components::only_merges_new(const chunk_t& chunk) const
+{
+	// Until now, the chunk was part of the unexplored region, and so was everything that steps
+	// into it. This stays true if every new region that steps out of the chunk still steps into
+	// the unexplored region.
+	vector<bool> has_steps(chunk.n_labels, false), is_unexplored(chunk.n_labels, false);
+	for (const auto& [label, outside] : chunk.border_steps)
+	{
+		has_steps[label] = true;
+		if (chunks.count(Pos::tile_to_chunk(outside)) == 0)
+			is_unexplored[label] = true;
+	}
+	return has_steps == is_unexplored;
+}
+
+void Components::compute(const WorldMap<walk_t>& map, const Pos& chunkpos, chunk_t& chunk)
+{
+	Pos origin = Pos::chunk_to_tile(chunkpos);
+	auto view = map.view(origin - Pos(2,2), origin + Pos(34,34), Pos(0,0));
+	Area area(origin, origin + Pos(32,32));
+
+	const label_t UNLABELED = numeric_limits<label_t>::max();
+	for (auto& column : chunk.labels)
+		column.fill(UNLABELED);
+	chunk.n_labels = 0;
+	chunk.border_steps.clear();
+
+	vector<Pos> todo;
+	for (int x = 0; x < 32; x++)
+		for (int y = 0; y < 32; y++)
+		{
+			if (chunk.labels[x][y] != UNLABELED)
+				continue;
+
+			label_t label = chunk.n_labels++;
+			chunk.labels[x][y] = label;
+			todo.push_back(origin + Pos(x,y));
+			while (!todo.empty())
+			{
+				Pos pos = todo.back();
+				todo.pop_back();
+				for (const Pos& step : STEPS)
+				{
+					Pos neighbor = pos + step;
+					if (!can_step(view, pos, step, SIZE) && !can_step(view, neighbor, Pos(0,0)-step, SIZE))
+						continue;
+
+					if (!area.contains(neighbor))
+						chunk.border_steps.emplace_back(label, neighbor);
+					else if (label_t& neighbor_label = chunk.labels[neighbor.x - origin.x][neighbor.y - origin.y]; neighbor_label == UNLABELED)
+					{
+						neighbor_label = label;
+						todo.push_back(neighbor);
+					}
+				}
+			}
+		}
+
+	chunk.valid = true;
+}
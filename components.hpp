@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2017, 2018 Florian Jung
+ *
+ * This file is part of factorio-bot.
+ *
+ * factorio-bot is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License,
+ * version 3, as published by the Free Software Foundation.
+ *
+ * factorio-bot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with factorio-bot. If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <cstdint>
+
+#include "pathfinding.hpp"
+#include "worldmap.hpp"
+#include "pos.hpp"
+#include "area.hpp"
+
+namespace pathfinding
+{
+	/** Labels the parts of the walk map that are connected to each other, so that queries between
+	  * different parts can be rejected without searching.
+	  *
+	  * Two vertices are connected if there is a step between them in either direction, so a path
+	  * may still exist in only one direction (diagonal steps are not symmetric). A region contains
+	  * all vertices that are connected through a chain of such steps. As wider characters can do
+	  * fewer steps, the regions are valid for all characters at least SIZE wide.
+	  *
+	  * Every chunk labels the regions within itself. The regions of all chunks are then joined
+	  * with a union-find structure along the steps across chunk borders. Chunks that do not exist
+	  * in the walk map are unexplored, and are considered one large region together.
+	  *
+	  * Changed chunks are relabeled lazily on the next query. If a change can only have joined
+	  * regions (e.g. a building was removed, or a chunk at the edge of the explored world appeared),
+	  * the new labels are merged into the union-find structure. If it may have split a region,
+	  * the union-find structure is rebuilt from the border steps that every chunk remembers, which
+	  * does not need to relabel any other chunk. Lookups may happen from several threads at once.
+	  */
+	class Components
+	{
+		public:
+			static constexpr double SIZE = 0.5;
+			/** may_reach() gives up on goal boxes with more vertices than this */
+			static constexpr int MAX_GOAL_VERTICES = 64*64;
+
+			/** returns false if there is certainly no path between `a` and `b` */
+			bool same_region(const WorldMap<walk_t>& map, const Pos& a, const Pos& b) const;
+			/** returns false if there is certainly no path from `start` to any position within
+			  * `allowed_distance` of `end` */
+			bool may_reach(const WorldMap<walk_t>& map, const Pos& start, const Area_f& end, double allowed_distance) const;
+
+			/** marks everything that depends on the tiles in `area` as outdated */
+			void invalidate(const Area& area);
+			/** forgets everything, e.g. because the whole walk map was replaced */
+			void clear();
+
+			struct stats_t
+			{
+				size_t relabeled_chunks = 0;
+				size_t merges = 0; // updates that were merged into the union-find structure
+				size_t rebuilds = 0; // updates that rebuilt it
+			};
+			stats_t stats() const { std::lock_guard<std::mutex> lock(chunks_mutex); return stats_; }
+
+		private:
+			using label_t = uint16_t;
+
+			struct chunk_t
+			{
+				bool valid = false;
+				Chunk<label_t> labels; // the chunk-local region of each vertex
+				label_t n_labels = 0;
+				// a vertex of this chunk (by its label) and one outside that it is connected to
+				std::vector< std::pair<label_t, Pos> > border_steps;
+			};
+
+			mutable std::mutex chunks_mutex;
+			mutable std::unordered_map< Pos, std::unique_ptr<chunk_t> > chunks;
+			mutable size_t n_map_chunks = 0; // to notice when the walk map grows
+
+			// the union-find structure over the regions of all chunks. Index 0 is the unexplored region.
+			mutable bool joined = false;
+			mutable std::unordered_map<Pos, uint32_t> first_index; // of each chunk's regions
+			mutable std::vector<uint32_t> parent;
+			mutable size_t n_live_regions = 0; // regions of the current labels; the rest of `parent` is outdated
+			mutable stats_t stats_;
+
+			void update(const WorldMap<walk_t>& map) const;
+			void rebuild() const;
+			void unite(uint32_t a, uint32_t b) const;
+			bool only_merges(const chunk_t& old_chunk, const chunk_t& chunk, std::vector<label_t>& new_label) const;
+			bool only_merges_new(const chunk_t& chunk) const;
+			uint32_t find(uint32_t index) const;
+			uint32_t region_of(const Pos& pos) const;
+			static void compute(const WorldMap<walk_t>& map, const Pos& chunkpos, chunk_t& chunk);
+	};
+}
@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2017, 2018 Florian Jung
+ *
+ * This file is part of factorio-bot.
+ *
+ * factorio-bot is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License,
+ * version 3, as published by the Free Software Foundation.
+ *
+ * factorio-bot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with factorio-bot. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+/** A priority queue stored as an implicit D-ary heap in a flat vector.
+  *
+  * Like std::priority_queue and boost::heap, top() is the *largest* element
+  * according to operator<. There is no decrease-key; users are expected to push
+  * a new entry instead and to skip outdated ones when they are popped. With D=4,
+  * all children of a node usually share a cache line, and the tree is half as
+  * deep as a binary heap.
+  */
+template <typename T, unsigned D = 4> class DaryHeap
+{
+	static_assert(D >= 2);
+
+	public:
+		bool empty() const { return data.empty(); }
+		size_t size() const { return data.size(); }
+		const T& top() const { return data.front(); }
+
+		void push(const T& value)
+		{
+			data.push_back(value);
+			sift_up(data.size()-1);
+		}
+
+		void pop()
+		{
+			data.front() = std::move(data.back());
+			data.pop_back();
+			if (!data.empty())
+				sift_down(0);
+		}
+
+		/** removes all elements, but keeps the memory for reuse */
+		void clear() { data.clear(); }
+
+	private:
+		std::vector<T> data;
+
+		void sift_up(size_t i)
+		{
+			T value = std::move(data[i]);
+			while (i > 0)
+			{
+				size_t parent = (i-1) / D;
+				if (!(data[parent] < value))
+					break;
+				data[i] = std::move(data[parent]);
+				i = parent;
+			}
+			data[i] = std::move(value);
+		}
+
+		void sift_down(size_t i)
+		{
+			T value = std::move(data[i]);
+			const size_t n = data.size();
+			while (true)
+			{
+				size_t first_child = i*D + 1;
+				if (first_child >= n)
+					break;
+
+				size_t largest = first_child;
+				size_t end = std::min(first_child + D, n);
+				for (size_t child = first_child+1; child < end; child++)
+					if (data[largest] < data[child])
+						largest = child;
+
+				if (!(value < data[largest]))
+					break;
+				data[i] = std::move(data[largest]);
+				i = largest;
+			}
+			data[i] = std::move(value);
+		}
+};
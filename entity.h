@@ -25,6 +25,8 @@
 #include <string>
 #include <memory>
 #include <algorithm>
+#include <functional>
+#include <cmath>
 
 struct ContainerData
 {
@@ -43,6 +45,7 @@ struct EntityPrototype
 {
 	static double max_collision_box_size;
 
+	size_t id = 0; // dense, in the order the prototypes were received
 	std::string name;
 	std::string type;
 	Area_f collision_box;
@@ -101,6 +104,18 @@ struct Entity
 		}
 	};
 
+	/** hashes what mostly_equals() compares, for WorldList's index */
+	struct mostly_equals_hash
+	{
+		size_t operator()(const Entity& entity) const
+		{
+			// Factorio's positions are multiples of 1/256 tiles
+			size_t x = size_t(std::llround(entity.pos.x * 256));
+			size_t y = size_t(std::llround(entity.pos.y * 256));
+			return (x * 73856093) ^ (y * 19349663) ^ std::hash<const void*>{}(entity.proto);
+		}
+	};
+
 	void takeover_data(Entity& that)
 	{
 		assert (this->proto == that.proto);
@@ -0,0 +1,91 @@
+/* Runs a fixed set of random queries around a lake with a_star(), a_star_jps() and
+ * a_star_alt(), and prints their times and path lengths. See README.md for how to
+ * build and run it. */
+
+#include "pathfinding.hpp"
+#include "jump_table.hpp"
+#include "landmarks.hpp"
+#include "pathfinder.hpp"
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <functional>
+
+using namespace std;
+using namespace pathfinding;
+
+static double length_of(const vector<Pos>& path)
+{
+	double length = 0.;
+	for (size_t i=1; i<path.size(); i++)
+		length += (path[i]-path[i-1]).len();
+	return length;
+}
+
+int main(int argc, char** argv)
+{
+	size_t n_queries = argc > 1 ? atoi(argv[1]) : 100;
+	const int LAKE = 48;
+
+	// known land around the origin, with a round lake in the middle
+	WorldMap<walk_t> map;
+	walk_t land;
+	land.known = true;
+	for (int x=-300; x<300; x++)
+		for (int y=-300; y<300; y++)
+		{
+			map.at(x,y) = land;
+			map.at(x,y).can_walk = Pos(x,y).len() > LAKE;
+		}
+
+	// from one shore to the opposite one, short enough for the Pathfinder not to use the PortalGraph
+	mt19937 rng(42);
+	uniform_real_distribution<double> angle(0., 2*M_PI), offset(-0.3, 0.3);
+	vector< pair<Pos,Pos> > queries;
+	while (queries.size() < n_queries)
+	{
+		double a = angle(rng), b = a + M_PI + offset(rng);
+		queries.emplace_back(Pos(lround(58*cos(a)), lround(58*sin(a))), Pos(lround(58*cos(b)), lround(58*sin(b))));
+	}
+
+	Landmarks landmarks;
+	landmarks.set_area(Area(-Landmarks::RADIUS, -Landmarks::RADIUS, Landmarks::RADIUS, Landmarks::RADIUS));
+	auto t0 = chrono::steady_clock::now();
+	landmarks.landmarks(map);
+	auto t1 = chrono::steady_clock::now();
+	cerr << "computing the landmarks: " << chrono::duration<double,milli>(t1-t0).count() << "ms" << endl;
+
+	// the queries for which the Pathfinder would use a_star_alt()
+	size_t detours = 0;
+	for (auto& [a,b] : queries)
+	{
+		Area_f end(b.to_double(), b.to_double());
+		if (landmarks.heuristic(map, end, 1.5)(a) > Pathfinder::DETOUR_FACTOR * max(0., distance(a, end) - 1.5))
+			detours++;
+	}
+	cerr << "the landmarks show a detour for " << detours << "/" << queries.size() << " queries" << endl;
+
+	// the jump table is computed lazily as well, so fill it before measuring
+	JumpTable jumps;
+	for (auto& [a,b] : queries)
+		a_star_jps_raw(a, Area_f(b.to_double(), b.to_double()), map, jumps, 1.5);
+	auto run = [&](const string& name, function<vector<Pos>(const Pos&, const Area_f&)> search) {
+		size_t found = 0;
+		double length = 0.;
+		auto t0 = chrono::steady_clock::now();
+		for (auto& [a,b] : queries)
+		{
+			vector<Pos> path = search(a, Area_f(b.to_double(), b.to_double()));
+			if (!path.empty())
+				found++;
+			length += length_of(path);
+		}
+		auto t1 = chrono::steady_clock::now();
+		cerr << name << ": " << chrono::duration<double,milli>(t1-t0).count() << "ms, found " << found << "/" << queries.size() << " paths, total length " << length << endl;
+	};
+
+	run("a_star", [&](const Pos& a, const Area_f& b) { return a_star_raw(a, b, map, 1.5); });
+	run("a_star_jps", [&](const Pos& a, const Area_f& b) { return a_star_jps_raw(a, b, map, jumps, 1.5); });
+	run("a_star_alt", [&](const Pos& a, const Area_f& b) { return a_star_alt_raw(a, b, map, landmarks, 1.5); });
+}
@@ -0,0 +1,54 @@
+/* Runs a fixed set of random a_star() queries on a recorded trace and
+ * prints the total time. See README.md for how to build and run it. */
+
+#include "factorio_io.h"
+#include "pathfinding.hpp"
+#include <chrono>
+#include <iostream>
+#include <random>
+
+using namespace std;
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		cerr << "usage: " << argv[0] << " trace.txt [n_queries]" << endl;
+		return 1;
+	}
+	size_t n_queries = argc > 2 ? atoi(argv[2]) : 200;
+
+	FactorioGame game(argv[1]);
+	while (true)
+	{
+		auto packet = game.read_packet();
+		if (packet.empty())
+			break;
+		game.parse_packet(packet);
+	}
+
+	mt19937 rng(42);
+	uniform_int_distribution<int> coord(-250,250);
+	vector< pair<Pos,Pos> > queries;
+	while (queries.size() < n_queries)
+	{
+		Pos a(coord(rng), coord(rng)), b(coord(rng), coord(rng));
+		if (game.walk_map.at(a).land() && game.walk_map.at(b).land())
+			queries.emplace_back(a,b);
+	}
+
+	size_t found = 0;
+	double length = 0.;
+	auto t0 = chrono::steady_clock::now();
+	for (auto& [a,b] : queries)
+	{
+		vector<Pos> path = a_star(a, Area_f(b.to_double(), b.to_double()), game.walk_map, 1.5, 0., 300);
+		if (!path.empty())
+			found++;
+		for (size_t i=1; i<path.size(); i++)
+			length += (path[i]-path[i-1]).len();
+	}
+	auto t1 = chrono::steady_clock::now();
+
+	cerr << chrono::duration<double,milli>(t1-t0).count() << "ms, found " << found << "/" << queries.size() << " paths, total length " << length << endl;
+}
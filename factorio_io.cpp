@@ -22,6 +22,7 @@
 #include <cstring>
 #include <set>
 #include <deque>
+#include <array>
 #include <algorithm>
 #include <cassert>
 
@@ -33,8 +34,6 @@
 #include "safe_cast.hpp"
 #include "logging.hpp"
 
-#define READ_BUFSIZE 1024
-
 using namespace std;
 
 const unordered_map<string, Resource::type_t> Resource::types = { {"coal", COAL}, {"iron-ore", IRON}, {"copper-ore", COPPER}, {"stone", STONE}, {"crude-oil", OIL}, {"uranium-ore", URANIUM} };
@@ -58,6 +57,38 @@ static const string dir4str[] = {
 	"defines.direction.west",
 };
 
+/** returns a std::string with the contents of `sv`. The same storage is reused on every call,
+  * so string-keyed maps can be searched without allocating. The result is only valid until
+  * the next call. */
+static const string& as_key(string_view sv)
+{
+	thread_local string buffer;
+	buffer.assign(sv);
+	return buffer;
+}
+
+/** the compact encoding (see doc/factorio_comm.md) writes unsigned numbers in base 64,
+  * least significant digit first, using the characters '0' (=0) up to 'o' (=63). */
+static uint64_t decode_compact_number(string_view digits)
+{
+	uint64_t result = 0;
+	for (size_t i = digits.size(); i-- > 0; )
+	{
+		unsigned digit = static_cast<unsigned char>(digits[i]) - unsigned('0');
+		if (digit >= 64)
+			throw runtime_error("malformed compact packet: invalid digit '"+string(1,digits[i])+"'");
+		result = result*64 + digit;
+	}
+	return result;
+}
+
+static constexpr size_t COMPACT_HEADER_SIZE = 24; // '#', type, tick(6), x(4), y(4), width(2), height(2), length(4)
+static constexpr size_t COMPACT_ENTITY_SIZE = 8;
+static constexpr int COMPACT_COORD_OFFSET = 1<<23;
+
+// if more entities changed in an objects packet, the whole area's walkmap is rebuilt at once
+static constexpr size_t MAX_FOOTPRINT_UPDATES = 32;
+
 FactorioGame::FactorioGame(string prefix) : rcon() // initialize with disconnected rcon
 {
 	factorio_file_prefix = prefix;
@@ -207,51 +238,57 @@ void FactorioGame::change_file_id(int new_id)
 	factorio_file_id = new_id;
 }
 
-string FactorioGame::remove_line_from_buffer()
-{
-	auto pos = line_buffer.find('\n');
-	string retval = line_buffer.substr(0,pos);
-	line_buffer=line_buffer.substr(pos+1);
-	return retval;
-}
-
-string FactorioGame::read_packet()
+string_view FactorioGame::read_packet()
 {
 	Logger log("core");
 
-	if (line_buffer.find('\n') != string::npos)
-		return remove_line_from_buffer();
-
-	if (!factorio_file.good() || !factorio_file.is_open())
+	if (!factorio_file.is_open())
 	{
-		log << "read_packet: file is not good. trying to open '" << factorio_file_prefix+to_string(factorio_file_id) << ".txt'..." << endl;
-		factorio_file.clear();
-		factorio_file.open(factorio_file_prefix+to_string(factorio_file_id)+".txt");
+		log << "read_packet: file is not open. trying to open '" << factorio_file_name() << "'..." << endl;
 
-		if (!factorio_file.good() || !factorio_file.is_open())
+		if (!factorio_file.open(factorio_file_name()))
 		{
 			log << "still failed :(" << endl;
-			return "";
+			return string_view();
 		}
 	}
 
-	char buf[READ_BUFSIZE];
-	while (!factorio_file.eof() && !factorio_file.fail())
-	{
-		factorio_file.read(buf, READ_BUFSIZE);
-		auto n_read = factorio_file.gcount();
-		line_buffer.append(buf, n_read);
-		if (memchr(buf,'\n', n_read)) break;
-	}
-	if (factorio_file.fail() && !factorio_file.eof())
-		throw std::runtime_error("file reading error");
-	
-	factorio_file.clear();
-	
-	if (line_buffer.find('\n') == string::npos)
-		return "";
+	return factorio_file.next_packet();
+}
+
+void FactorioGame::intern_prototypes()
+{
+	entity_prototype_index.freeze();
+	item_prototype_index.freeze();
+
+	resource_types.assign(entity_prototype_index.size(), Resource::NONE);
+	for (const auto& [name, type] : Resource::types)
+		if (const EntityPrototype* proto = entity_prototype_index.find(name))
+			resource_types[proto->id] = type;
+}
+
+const EntityPrototype& FactorioGame::get_entity_prototype(string_view name) const
+{
+	if (entity_prototype_index.is_frozen())
+		return entity_prototype_index.at(name);
 	else
-		return remove_line_from_buffer();
+		return *entity_prototypes.at(as_key(name));
+}
+
+const ItemPrototype& FactorioGame::get_item_prototype(string_view name) const
+{
+	if (item_prototype_index.is_frozen())
+		return item_prototype_index.at(name);
+	else
+		return *item_prototypes.at(as_key(name));
+}
+
+Resource::type_t FactorioGame::resource_type_of(const EntityPrototype* proto) const
+{
+	if (proto->id < resource_types.size() && entity_prototype_index[proto->id] == proto && resource_types[proto->id] != Resource::NONE)
+		return resource_types[proto->id];
+	else
+		return Resource::types.at(proto->name);
 }
 
 void FactorioGame::resolve_references_to_items()
@@ -265,40 +302,140 @@ void FactorioGame::resolve_references_to_items()
 	}
 }
 
-bool FactorioGame::parse_packet(const string& pkg)
+bool FactorioGame::parse_packet(string_view pkg)
 {
-	Logger log("core");
+	decoded_packet_t packet = decode_packet(pkg);
+	packet.file_offset = read_position();
+	return commit_packet(move(packet));
+}
+
+FactorioGame::decoded_packet_t FactorioGame::decode_packet(string_view pkg) const
+{
+	decoded_packet_t packet;
 
-	if (pkg=="") return false;
+	if (pkg.empty()) return packet;
+
+	if (pkg[0] == '#')
+	{
+		decode_compact_packet(pkg, packet);
+		return packet;
+	}
 
 	auto colon = pkg.find(':');
 
-	if (colon == string::npos)
-		throw runtime_error("malformed packet: missing colon");
+	if (colon == string_view::npos)
+	{
+		// the only packet without any data
+		auto [tick, type] = unpack<int, string_view>(pkg);
+		if (type != "STATIC_DATA_END")
+			throw runtime_error("malformed packet: missing colon");
+
+		packet.tick = tick;
+		packet.type = type;
+		return packet;
+	}
 
-	vector<string> prelude = split(pkg.substr(0, colon), ' ');
-	string data = pkg.substr(colon+2); // skip space
+	string_view prelude[3];
+	size_t n_prelude = 0;
+	for (string_view field : split_view(pkg.substr(0, colon), ' '))
+	{
+		if (n_prelude == 3)
+			throw runtime_error("malformed packed: invalid prelude");
+		prelude[n_prelude++] = field;
+	}
+	string_view data = pkg.substr(colon+2); // skip space
 
-	if (prelude.size() != 2 && prelude.size() != 3)
+	if (n_prelude != 2 && n_prelude != 3)
 		throw runtime_error("malformed packed: invalid prelude");
 
-	string tickstr = prelude[0];
+	packet.tick = convert<int>(prelude[0]);
+	packet.type = prelude[1];
+	packet.data = data;
+	if (n_prelude >= 3)
+		packet.area = Area(prelude[2]);
 
-	int tick = stoi(tickstr);
-	if (last_tick > tick)
-		log << "wtf, tick decreased from " << last_tick << " to " << tick << endl;
-	last_tick = tick;
+	if (packet.type=="tiles")
+		decode_tiles(packet);
+	else if (packet.type=="resources")
+		decode_resources(packet);
+	else if (packet.type=="objects")
+		decode_objects(packet);
 
-	string type = prelude[1];
+	return packet;
+}
+
+void FactorioGame::decode_compact_packet(string_view pkg, decoded_packet_t& packet) const
+{
+	if (pkg.size() < COMPACT_HEADER_SIZE)
+		throw runtime_error("malformed compact packet: truncated header");
+
+	packet.compact = true;
+	packet.tick = int(decode_compact_number(pkg.substr(2,6)));
+
+	Pos left_top( int(decode_compact_number(pkg.substr(8,4))) - COMPACT_COORD_OFFSET,
+	              int(decode_compact_number(pkg.substr(12,4))) - COMPACT_COORD_OFFSET );
+	Pos size( int(decode_compact_number(pkg.substr(16,2))), int(decode_compact_number(pkg.substr(18,2))) );
+	packet.area = Area(left_top, left_top + size);
+
+	size_t length = decode_compact_number(pkg.substr(20,4));
+	packet.data = pkg.substr(COMPACT_HEADER_SIZE);
+	if (packet.data.size() != length)
+		throw runtime_error("malformed compact packet: expected "+to_string(length)+" bytes of payload, got "+to_string(packet.data.size()));
+
+	switch (pkg[1])
+	{
+		case 'T':
+			packet.type = "tiles";
+			decode_tiles(packet);
+			break;
+		case 'R':
+			packet.type = "resources";
+			decode_resources(packet);
+			break;
+		case 'O':
+			packet.type = "objects";
+			decode_objects(packet);
+			break;
+		default:
+			throw runtime_error("unknown compact packet type '"+string(1,pkg[1])+"'");
+	}
+}
+
+Entity FactorioGame::decode_compact_entity(string_view record, Pos left_top) const
+{
+	uint64_t value = decode_compact_number(record);
+	size_t proto_id = value >> 32;
+	unsigned x = (value >> 16) & 0xFFFF;
+	unsigned y = value & 0xFFFF;
+	dir4_t dir = dir4_t(x >> 14);
+	x &= 0x3FFF;
+
+	if (proto_id >= entity_prototype_index.size())
+		throw runtime_error("malformed compact packet: invalid prototype id "+to_string(proto_id));
+
+	return Entity(Pos_f(left_top.x + x/256., left_top.y + y/256.), entity_prototype_index[proto_id], dir);
+}
+
+bool FactorioGame::commit_packet(decoded_packet_t&& packet)
+{
+	Logger log("core");
+
+	if (packet.file_offset)
+		committed_file_offset = packet.file_offset;
+
+	if (packet.type.empty()) return false;
+
+	if (last_tick > packet.tick)
+		log << "wtf, tick decreased from " << last_tick << " to " << packet.tick << endl;
+	last_tick = packet.tick;
+
+	const string_view type = packet.type;
+	const string_view data = packet.data;
 
-	Area area;
-	if (prelude.size() >= 3)
-		area = Area(prelude[2]);
-	
 	if (type=="tiles")
-		parse_tiles(area, data);
+		apply_tiles(packet);
 	else if (type=="resources")
-		parse_resources(area, data);
+		apply_resources(packet);
 	else if (type=="entity_prototypes")
 		parse_entity_prototypes(data);
 	else if (type=="item_prototypes")
@@ -311,7 +448,11 @@ bool FactorioGame::parse_packet(const string& pkg)
 	else if (type=="graphics")
 		parse_graphics(data);
 	else if (type=="objects")
-		parse_objects(area,data);
+		apply_objects(packet);
+	else if (type=="entity_added")
+		parse_entity_added(data);
+	else if (type=="entity_removed")
+		parse_entity_removed(data);
 	else if (type=="players")
 		parse_players(data);
 	else if (type=="action_completed")
@@ -321,38 +462,49 @@ bool FactorioGame::parse_packet(const string& pkg)
 	else if (type=="inventory_changed")
 		parse_inventory_changed(data);
 	else if (type=="item_containers")
-		parse_item_containers(data);
+		parse_item_containers(data, false);
+	else if (type=="item_container_delta")
+		parse_item_containers(data, true);
 	else if (type=="tick")
 		return true;
+	else if (type=="STATIC_DATA_END")
+		intern_prototypes();
 	else
-		throw runtime_error("unknown packet type '"+type+"'");
+		throw runtime_error("unknown packet type '"+string(type)+"'");
 	
 	return false;
 }
 
-void FactorioGame::parse_item_containers(const string& data_str)
+void FactorioGame::parse_item_containers(string_view data_str, bool delta)
 {
 	Logger log("container");
 
-	for (const string& container : split(data_str, ',')) if (!container.empty())
+	for (string_view container : split_view(data_str, ',')) if (!container.empty())
 	{
-		auto [name, ent_x, ent_y, contents] = unpack<string,double,double,string>(container, ' ');
+		auto [name, ent_x, ent_y, contents] = unpack<string_view,double,double,string_view>(container, ' ');
 
-		if (auto entity = actual_entities.search_or_null(Entity(Pos_f(ent_x,ent_y),entity_prototypes.at(name).get())))
+		if (auto entity = actual_entities.search_or_null(Entity(Pos_f(ent_x,ent_y),&get_entity_prototype(name))))
 		{
 			if (auto* data = entity->data_or_null<ContainerData>())
 			{
-				data->inventories.clear();
+				if (!delta)
+					data->inventories.clear();
 
-				for (const string& inv_string : split(contents, '+'))
+				for (string_view inv_string : split_view(contents, '+'))
 				{
-					auto [invtype_str, invcontent] = unpack<string, string>(inv_string, '=');
-					inventory_t invtype = inventory_types.at("defines.inventory."+invtype_str);
+					auto [invtype_str, invcontent] = unpack<string_view, string_view>(inv_string, '=');
+					inventory_t invtype = inventory_types.at("defines.inventory."+string(invtype_str));
 
-					for (const string& itemstack : split(invcontent, '%'))
+					for (string_view itemstack : split_view(invcontent, '%'))
 					{
-						auto [item, amount] = unpack<string, size_t>(itemstack,':');
-						auto [_,inserted] = data->inventories.insert(invtype, item_prototypes.at(item).get(), amount);
+						auto [item, amount] = unpack<string_view, size_t>(itemstack,':');
+						if (delta)
+						{
+							data->inventories.set(invtype, &get_item_prototype(item), amount);
+							continue;
+						}
+
+						auto [_,inserted] = data->inventories.insert(invtype, &get_item_prototype(item), amount);
 						if (!inserted)
 							throw runtime_error("malformed parse_item_containers packet: duplicate item");
 					}
@@ -368,7 +520,7 @@ void FactorioGame::parse_item_containers(const string& data_str)
 	}
 }
 
-void FactorioGame::parse_graphics(const string& data)
+void FactorioGame::parse_graphics(string_view data)
 {
 	for (const string& gfxstring : split(data, '|'))
 	{
@@ -413,7 +565,7 @@ void FactorioGame::parse_graphics(const string& data)
 	}
 }
 
-void FactorioGame::parse_mined_item(const string& data)
+void FactorioGame::parse_mined_item(string_view data)
 {
 	auto [id_, itemname, amount] = unpack<int, string, int>(data, ' ');
 
@@ -425,17 +577,17 @@ void FactorioGame::parse_mined_item(const string& data)
 		players[id].actions->on_mined_item(itemname, amount);
 }
 
-void FactorioGame::parse_inventory_changed(const string& data)
+void FactorioGame::parse_inventory_changed(string_view data)
 {
 	Logger log("inventory");
 
 	std::set<int> affected_players;
-	for (const string& update : split(data, ' '))
+	for (string_view update : split_view(data, ' '))
 	{ 
-		auto [player_id, item, diff, owner_str] = unpack<int,string,int,string>(update, ',');
+		auto [player_id, item, diff, owner_str] = unpack<int,string_view,int,string_view>(update, ',');
 		bool has_owner = owner_str!="x";
-		int owning_action_id = has_owner ? stoi(owner_str) : -1;
-		const ItemPrototype* proto = item_prototypes.at(item).get();
+		int owning_action_id = has_owner ? convert<int>(owner_str) : -1;
+		const ItemPrototype* proto = &get_item_prototype(item);
 		affected_players.insert(player_id);
 		
 		if (size_t(player_id) >= players.size())
@@ -450,7 +602,7 @@ void FactorioGame::parse_inventory_changed(const string& data)
 		TaggedAmount& content = players[player_id].inventory[proto];
 
 		if (long(content.amount) < -diff)
-			throw runtime_error("inventory desync detected: game removed more '"+item+"' items ("+to_string(diff)+") than we actually have ("+to_string(content.amount)+")");
+			throw runtime_error("inventory desync detected: game removed more '"+string(item)+"' items ("+to_string(diff)+") than we actually have ("+to_string(content.amount)+")");
 
 		content.amount += diff;
 		if (has_owner && diff > 0)
@@ -463,7 +615,7 @@ void FactorioGame::parse_inventory_changed(const string& data)
 				{
 					size_t added = content.add_claim(*action->owner, diff);
 					if (added != safe_cast<size_t>(diff))
-						throw runtime_error("inventory desync detected: game added "+to_string(diff)+"x '"+item+"' with an owning task, but only "+to_string(added)+" could be claimed");
+						throw runtime_error("inventory desync detected: game added "+to_string(diff)+"x '"+string(item)+"' with an owning task, but only "+to_string(added)+" could be claimed");
 				}
 				else
 					log << "WARN: action with the action id " << owning_action_id << " has no owning task, yet it changed the inventory?" << endl;
@@ -481,23 +633,19 @@ void FactorioGame::parse_inventory_changed(const string& data)
 	}
 }
 
-void FactorioGame::parse_players(const string& data)
+void FactorioGame::parse_players(string_view data)
 {
 	for (Player& p : players)
 		p.connected = false;
 
-	for (const string& entry : split(data,','))
+	for (string_view entry : split_view(data,','))
 	{
-		vector<string> fields = split(entry,' ');
-
-		if (fields.size() != 3)
-			throw runtime_error("malformed players packet");
+		auto [id_, x, y] = unpack<int,double,double>(entry,' ');
 
-		int id_ = stoi(fields[0]);
 		if (id_ < 0)
 			throw runtime_error("invalid player id in parse_players()");
 		unsigned id = unsigned(id_);
-		Pos_f pos = Pos_f(stod(fields[1]), stod(fields[2]));
+		Pos_f pos = Pos_f(x, y);
 
 		if (id >= players.size())
 			players.resize(id + 1);
@@ -508,11 +656,11 @@ void FactorioGame::parse_players(const string& data)
 	}
 }
 
-void FactorioGame::parse_action_completed(const string& data)
+void FactorioGame::parse_action_completed(string_view data)
 {
 	Logger log("core");
 
-	auto [type, action_id] = unpack<string,int>(data,' ');
+	auto [type, action_id] = unpack<string_view,int>(data,' ');
 
 	if (type != "ok" && type != "fail")
 		throw runtime_error("malformed action_completed packet, expected 'ok' or 'fail'");
@@ -523,70 +671,71 @@ void FactorioGame::parse_action_completed(const string& data)
 		log << "WARN: unknown action finished (id=" << action_id << ")" << endl;
 }
 
-void FactorioGame::parse_entity_prototypes(const string& data)
+void FactorioGame::parse_entity_prototypes(string_view data)
 {
-	for (string entry : split(data, '$')) if (entry!="")
+	for (string_view entry : split_view(data, '$')) if (!entry.empty())
 	{
-		auto [name, type, collision, collision_box, mine_results] = unpack<string,string,string,Area_f,string>(entry);
+		auto [name, type, collision, collision_box, mine_results] = unpack<string,string,string,Area_f,string_view>(entry);
 
 		bool mineable = (mine_results != "-");
 		vector< pair<string, size_t> > mine_results_str;
 		if (mineable)
 		{
-			for (string product : split(mine_results, ','))
+			for (string_view product : split_view(mine_results, ','))
 			{
 				const auto [item, amount] = unpack<string, int>(product, ':');
 				mine_results_str.emplace_back(item, amount);
 			}
 		}
 
-		entity_prototypes[name] = make_unique<EntityPrototype>(name, type, collision, collision_box, mineable, mine_results_str); // prototypes will never change.
+		auto proto = make_unique<EntityPrototype>(name, type, collision, collision_box, mineable, mine_results_str); // prototypes will never change.
+		proto->id = entity_prototype_index.size();
+		entity_prototype_index.add(proto.get());
+		entity_prototypes[name] = move(proto);
 		max_entity_radius = max(max_entity_radius, collision_box.radius());
 	}
 }
 
-void FactorioGame::parse_item_prototypes(const string& data)
+void FactorioGame::parse_item_prototypes(string_view data)
 {
-	for (string entry : split(data, '$')) if (entry!="")
+	for (string_view entry : split_view(data, '$')) if (!entry.empty())
 	{
-		auto [name, type, place_result_str, stack_size, fuel_value, speed, durability] = unpack<string,string,string,int,double,double,double>(entry);
+		auto [name, type, place_result_str, stack_size, fuel_value, speed, durability] = unpack<string,string,string_view,int,double,double,double>(entry);
 
 		const EntityPrototype* place_result;
 		if (place_result_str != "nil")
-			place_result = entity_prototypes.at(place_result_str).get();
+			place_result = &get_entity_prototype(place_result_str);
 		else
 			place_result = nullptr;
 
-		item_prototypes[name] = make_unique<ItemPrototype>(name, type, place_result, stack_size, fuel_value, speed, durability); // prototypes will never change.
+		auto proto = make_unique<ItemPrototype>(name, type, place_result, stack_size, fuel_value, speed, durability); // prototypes will never change.
+		proto->id = item_prototype_index.size();
+		item_prototype_index.add(proto.get());
+		item_prototypes[name] = move(proto);
 	}
 }
 
-void FactorioGame::parse_recipes(const string& data)
+void FactorioGame::parse_recipes(string_view data)
 {
-	for (string recipestr : split(data,'$'))
+	for (string_view recipestr : split_view(data,'$'))
 	{
 		auto recipe = make_unique<Recipe>();
 
-		vector<string> fields = split(recipestr,' ');
-		if (fields.size() != 5)
-			throw runtime_error("malformed parse_recipes packet");
-
-		recipe->name = fields[0];
-		recipe->enabled = bool(stoi(fields[1]));
-		recipe->energy = stod(fields[2]);
-		const string& ingredients = fields[3];
-		const string& products = fields[4];
+		auto [name, enabled, energy, ingredients, products] = unpack<string,bool,double,string_view,string_view>(recipestr,' ');
+		recipe->name = move(name);
+		recipe->enabled = enabled;
+		recipe->energy = energy;
 
-		for (string ingstr : split(ingredients, ','))
+		for (string_view ingstr : split_view(ingredients, ','))
 		{
-			auto [ingredient, amount] = unpack<string,int>(ingstr, '*');
-			recipe->ingredients.emplace_back(item_prototypes.at(ingredient).get(), amount);
+			auto [ingredient, amount] = unpack<string_view,int>(ingstr, '*');
+			recipe->ingredients.emplace_back(&get_item_prototype(ingredient), amount);
 		}
 
-		for (string prodstr : split(products, ','))
+		for (string_view prodstr : split_view(products, ','))
 		{
-			auto [product, amount] = unpack<string,double>(prodstr,'*');
-			recipe->products.emplace_back(item_prototypes.at(product).get(), amount);
+			auto [product, amount] = unpack<string_view,double>(prodstr,'*');
+			recipe->products.emplace_back(&get_item_prototype(product), amount);
 		}
 
 		recipes[recipe->name] = move(recipe);
@@ -628,11 +777,37 @@ void FactorioGame::update_resource_field(Resource& entry, Resource::type_t new_t
 	}
 }
 
-void FactorioGame::parse_tiles(const Area& area, const string& data)
+void FactorioGame::decode_tiles(decoded_packet_t& packet) const
 {
-	if (data.length() != 1024+1023)
-		throw runtime_error("parse_tiles: invalid length");
-	
+	if (packet.area.size() != Pos(32,32))
+		throw runtime_error("parse_tiles: invalid area");
+
+	if (packet.compact)
+	{
+		// a bitmap of obstructed tiles, six tiles per digit
+		if (packet.data.length() != (1024+5)/6)
+			throw runtime_error("parse_tiles: invalid length");
+
+		for (size_t digit=0; digit<packet.data.length(); digit++)
+		{
+			auto bits = decode_compact_number(packet.data.substr(digit, 1));
+			for (size_t i = digit*6; i < min(digit*6+6, size_t(1024)); i++)
+				packet.walkable[i] = !(bits & (1 << (i%6)));
+		}
+	}
+	else
+	{
+		if (packet.data.length() != 1024+1023)
+			throw runtime_error("parse_tiles: invalid length");
+
+		for (int i=0; i<1024; i++)
+			packet.walkable[i] = (packet.data[2*i]=='0');
+	}
+}
+
+void FactorioGame::apply_tiles(const decoded_packet_t& packet)
+{
+	const Area& area = packet.area;
 	auto view = walk_map.view(area.left_top, area.right_bottom, area.left_top);
 	auto resview = resource_map.view(area.left_top - Pos(32,32), area.right_bottom + Pos(32,32), Pos(0,0));
 
@@ -641,7 +816,7 @@ void FactorioGame::parse_tiles(const Area& area, const string& data)
 		int x = i%32;
 		int y = i/32;
 		view.at(x,y).known = true;
-		view.at(x,y).can_walk = (data[2*i]=='0');
+		view.at(x,y).can_walk = packet.walkable[i];
 		
 		bool is_water = !view.at(x,y).can_walk; // FIXME: this is used to recognize "water" for now
 
@@ -655,6 +830,7 @@ void FactorioGame::parse_tiles(const Area& area, const string& data)
 		if ((old_type == Resource::OCEAN) != (type == Resource::OCEAN))
 			update_resource_field(entry, type, abspos, Entity(Entity::nullent_tag{}, abspos));
 	}
+	pathfinder.invalidate(area);
 	
 	resource_bookkeeping(area, resview);
 }
@@ -674,113 +850,236 @@ void FactorioGame::resource_bookkeeping(const Area& area, WorldMap<Resource>::Vi
 	assert_resource_consistency();
 }
 
-void FactorioGame::parse_objects(const Area& area, const string& data)
+void FactorioGame::decode_objects(decoded_packet_t& packet) const
 {
 	Logger log("objects");
 
-	// clean up pending_entities
-	for (auto it = pending_entities.begin(); it != pending_entities.end(); )
+	const Area& area = packet.area;
+
+	auto add_object = [&](Entity&& ent)
 	{
-		if (it->last_valid_tick < get_tick())
+		// ignore various ever-moving entities that need to be handled specially
+		if (ent.proto->name == "player")
+			return;
+
+		if (!area.contains(ent.pos.to_int_floor()))
 		{
-			log << "removing timed out pending entity" << endl;
-			it = unordered_erase(pending_entities, it);
+			// this indicates a bug in the lua mod
+			log << "FIXME: parse_objects packet contained an object (at "<<ent.pos.str()<<") that does not belong to area (" << area.str() << "). ignoring" << endl;
+			return;
 		}
-		else
-			it++;
+
+		packet.objects.push_back(std::move(ent));
+	};
+
+	if (packet.compact)
+	{
+		if (packet.data.size() % COMPACT_ENTITY_SIZE != 0)
+			throw runtime_error("parse_objects: invalid length");
+
+		for (size_t i=0; i<packet.data.size(); i+=COMPACT_ENTITY_SIZE)
+			add_object(decode_compact_entity(packet.data.substr(i, COMPACT_ENTITY_SIZE), area.left_top));
+		return;
 	}
 
-	bool debug_pending_entities = false;
-	if (pending_entities.size() > 0)
+	for (string_view entry : split_view(packet.data, ',')) if (!entry.empty())
+		add_object(decode_object_entry(entry));
+}
+
+Entity FactorioGame::decode_object_entry(string_view entry) const
+{
+	auto [name,ent_x,ent_y,dir] = unpack<string_view,double,double,string_view>(entry);
+
+	if (dir.length() != 1)
+		throw runtime_error("invalid direction '"+string(dir)+"' in parse_objects");
+	dir4_t dir4;
+	switch(dir[0])
+	{
+		case 'N': dir4 = NORTH; break;
+		case 'E': dir4 = EAST; break;
+		case 'S': dir4 = SOUTH; break;
+		case 'W': dir4 = WEST; break;
+		default: throw runtime_error("invalid direction '"+string(dir)+"' in parse_objects");
+	};
+
+	return Entity(Pos_f(ent_x,ent_y), &get_entity_prototype(name), dir4);
+}
+
+void FactorioGame::apply_objects(decoded_packet_t& packet)
+{
+	const Area& area = packet.area;
+	Entity::mostly_equals_hash hash;
+
+	// clean up pending_entities, which can only time out once per tick
+	if (pending_entities_cleanup_tick != get_tick())
 	{
-		// FIXME DEBUG only
-		debug_pending_entities = true;
-		log << "pending_entities.size() == " << pending_entities.size() << endl;
-		for (const auto& pe : pending_entities)
+		for (auto it = pending_entities.begin(); it != pending_entities.end(); )
 		{
-			log << "-> pending entity: " << pe.entity.str() << " (best before " << pe.last_valid_tick << ")" << endl;
-			if (const ContainerData* data = pe.entity.data_or_null<ContainerData>())
-				log << "  fuel_is_output = " << data->fuel_is_output << endl;
+			if (it->second.last_valid_tick < get_tick())
+			{
+				it = pending_entities.erase(it);
+				object_stats_.expired++;
+			}
+			else
+				it++;
 		}
+		pending_entities_cleanup_tick = get_tick();
 	}
 
-	// move all entities in the area from actual_entities to the temporary pending_entities list.
+	// take all entities in the area out of actual_entities
+	pending_entities_t previous;
 	auto range = actual_entities.within_range(area);
 	for (auto it = range.begin(); it != range.end();)
 	{
-		pending_entities.push_back({get_tick(), std::move(*it)});
+		previous.emplace(hash(*it), best_before_entity_t{get_tick(), std::move(*it)});
 		it = actual_entities.erase(it);
 	}
 
-	struct { int reused=0; int total=0; } stats; // DEBUG only
+	// the collision boxes of all entities that appeared, disappeared or turned
+	vector<Area_f> changed;
+
+	// commit the packet's list of objects. Prefer the entity that was in the area before over
+	// pending ones from elsewhere.
+	for (Entity& ent : packet.objects)
+	{
+		Area_f old_box;
+		if (take_over_data(previous, ent, &old_box))
+		{
+			object_stats_.kept++;
+			if (!(old_box == ent.collision_box()))
+			{
+				changed.push_back(old_box);
+				changed.push_back(ent.collision_box());
+			}
+		}
+		else
+		{
+			if (take_over_data(pending_entities, ent))
+				object_stats_.kept++;
+			else
+				object_stats_.added++;
+			changed.push_back(ent.collision_box());
+		}
+
+		actual_entities.insert(std::move(ent));
+	}
+
+	// those that were not reported again might still show up in another area during this tick
+	object_stats_.removed += previous.size();
+	for (const auto& [_, pending] : previous)
+		changed.push_back(pending.entity.collision_box());
+	pending_entities.merge(previous);
 
-	// parse the packet's list of objects
-	for (string entry : split(data, ',')) if (entry!="")
+	// finally, update the walkmap. Usually, only a few entities have changed, and only the tiles under
+	// them are updated. Otherwise (e.g. when the area is seen for the first time), the whole area is
+	// rebuilt; because our entities have a certain size, we must update a larger portion.
+	if (changed.size() <= MAX_FOOTPRINT_UPDATES)
 	{
-		auto [name,ent_x,ent_y,dir] = unpack<string,double,double,string>(entry);
+		for (const Area_f& box : changed)
+			update_walkmap(box.outer());
+	}
+	else
+		update_walkmap(area.expand(int(ceil(max_entity_radius))));
+}
 
-		if (dir.length() != 1)
-			throw runtime_error("invalid direction '"+dir+"' in parse_objects");
-		dir4_t dir4;
-		switch(dir[0])
+bool FactorioGame::take_over_data(pending_entities_t& candidates, Entity& ent, Area_f* old_box)
+{
+	auto [first, last] = candidates.equal_range(Entity::mostly_equals_hash()(ent));
+	for (auto it = first; it != last; ++it)
+		if (it->second.entity.mostly_equals(ent)) // found (modulo rotation and data_ptr)
 		{
-			case 'N': dir4 = NORTH; break;
-			case 'E': dir4 = EAST; break;
-			case 'S': dir4 = SOUTH; break;
-			case 'W': dir4 = WEST; break;
-			default: throw runtime_error("invalid direction '"+dir+"' in parse_objects");
-		};
+			if (old_box)
+				*old_box = it->second.entity.collision_box();
+			ent.takeover_data(it->second.entity);
+			candidates.erase(it);
+			return true;
+		}
+	return false;
+}
 
-		Entity ent(Pos_f(ent_x,ent_y), entity_prototypes.at(name).get(), dir4);
+void FactorioGame::parse_entity_added(string_view data)
+{
+	for (string_view entry : split_view(data, ',')) if (!entry.empty())
+	{
+		Entity ent = decode_object_entry(entry);
+		if (ent.proto->name == "player")
+			continue;
 
-		// ignore various ever-moving entities that need to be handled specially
-		if (name == "player")
+		Area_f box = ent.collision_box();
+		if (Entity* known = actual_entities.search_or_null(ent))
+		{
+			// already known, e.g. a pipe that was turned because a neighbor was built
+			box = box.expand(known->collision_box());
+			known->direction = ent.direction;
+			object_stats_.kept++;
+		}
+		else
+		{
+			if (take_over_data(pending_entities, ent))
+				object_stats_.kept++;
+			else
+				object_stats_.added++;
+			actual_entities.insert(std::move(ent));
+		}
+
+		update_walkmap(box.outer());
+	}
+}
+
+void FactorioGame::parse_entity_removed(string_view data)
+{
+	Logger log("objects");
+
+	for (string_view entry : split_view(data, ',')) if (!entry.empty())
+	{
+		Entity ent = decode_object_entry(entry);
+		if (ent.proto->name == "player")
 			continue;
 
-		if (!area.contains(ent.pos.to_int_floor()))
+		const Entity* known = actual_entities.search_or_null(ent);
+		if (!known)
 		{
-			// this indicates a bug in the lua mod
-			log << "FIXME: parse_objects packet contained an object (at "<<ent.pos.str()<<") that does not belong to area (" << area.str() << "). ignoring" << endl;
+			log << "entity_removed packet for unknown entity " << ent.str() << ", ignoring" << endl;
 			continue;
 		}
 
-		// try to find ent in pending_entities
-		stats.total++;
-		for (auto it = pending_entities.begin(); it != pending_entities.end(); )
-			if (it->entity.mostly_equals(ent)) // found (modulo rotation and data_ptr)
-			{
-				ent.takeover_data(it->entity);
-				it = unordered_erase(pending_entities, it);
-				stats.reused++;
-				break;
-			}
-			else
-				it++;
+		Area box = known->collision_box().outer();
+		actual_entities.erase(ent);
+		object_stats_.removed++;
 
-		// now place ent_ptr in the appropriate list.
-		actual_entities.insert(std::move(ent));
+		update_walkmap(box);
 	}
-
-	if (debug_pending_entities)
-		log << "in parse_objects(" << area.str() << "): reused " << stats.reused << ", had to create " << (stats.total-stats.reused) << " and deleted " << pending_entities.size() << endl; // DEBUG
-	
-	
-	// finally, update the walkmap; because our entities have a certain size, we must update a larger portion
-	update_walkmap(area.expand(int(ceil(max_entity_radius))));
 }
 
 void FactorioGame::update_walkmap(const Area& area)
 {
-	auto view = walk_map.view(area.left_top, area.right_bottom, Pos(0,0));
-	//cout << "update_walkmap("<<area.str()<<")"<<endl; // DEBUG
-
-	// clear margins
-	for (int x = area.left_top.x; x < area.right_bottom.x; x++)
-		for (int y = area.left_top.y; y < area.right_bottom.y; y++)
-			for (int i=0; i<4; i++)
-				view.at(x,y).margins[i] = 1.;
+	const int width = area.right_bottom.x - area.left_top.x;
+	const int height = area.right_bottom.y - area.left_top.y;
+	if (width <= 0 || height <= 0)
+		return;
 
-	for (const auto& ent : actual_entities.within_range(area))
+	// The margins of the tiles in `area`, in row order, one plane per direction. All entities are
+	// rasterized into these first, because plain arrays let the compiler vectorize the loops and
+	// walk_map's chunks need only be looked up once at the end.
+	// Every entity only lowers margins, so the order in which they are rasterized does not matter.
+	static thread_local array<vector<uint16_t>, 4> planes; // reused, to avoid allocations for small areas
+	for (auto& plane : planes)
+		plane.assign(size_t(width) * height, pathfinding::margin_t::ONE);
+
+	// lowers the margin `dir` to `value` in the row (or column) of tiles [from,to)
+	auto lower_row = [&](int dir, int y, int from, int to, uint16_t value) {
+		uint16_t* row = planes[dir].data() + size_t(y - area.left_top.y) * width - area.left_top.x;
+		for (int x = from; x < to; x++)
+			row[x] = min(row[x], value);
+	};
+	auto lower_column = [&](int dir, int x, int from, int to, uint16_t value) {
+		uint16_t* column = planes[dir].data() + (x - area.left_top.x) - size_t(area.left_top.y) * width;
+		for (int y = from; y < to; y++)
+			column[size_t(y) * width] = min(column[size_t(y) * width], value);
+	};
+
+	// entities whose center lies outside of `area` may still cover some of its tiles
+	for (const auto& ent : actual_entities.overlap_range(area))
 	{
 		// update walk_t information
 		if (ent.proto->collides_player)
@@ -792,96 +1091,76 @@ void FactorioGame::update_walkmap(const Area& area)
 			Area relevant_inner = inner.intersect(area);
 
 			// calculate margins
-			double rightmargin_of_lefttile = box.left_top.x - outer.left_top.x;
-			double leftmargin_of_righttile = outer.right_bottom.x - box.right_bottom.x;
-			double bottommargin_of_toptile = box.left_top.y - outer.left_top.y;
-			double topmargin_of_bottomtile = outer.right_bottom.y - box.right_bottom.y;
+			uint16_t rightmargin_of_lefttile = pathfinding::margin_t(box.left_top.x - outer.left_top.x).raw();
+			uint16_t leftmargin_of_righttile = pathfinding::margin_t(outer.right_bottom.x - box.right_bottom.x).raw();
+			uint16_t bottommargin_of_toptile = pathfinding::margin_t(box.left_top.y - outer.left_top.y).raw();
+			uint16_t topmargin_of_bottomtile = pathfinding::margin_t(outer.right_bottom.y - box.right_bottom.y).raw();
+
+			bool multiple_rows = outer.right_bottom.y-1 != outer.left_top.y;
+			bool multiple_columns = outer.right_bottom.x-1 != outer.left_top.x;
 
 			if (area.contains_y(outer.left_top.y))
 			{
-				for (int x = relevant_outer.left_top.x; x < relevant_outer.right_bottom.x; x++)
-				{
-					auto& tile = view.at(x, outer.left_top.y);
-					double& margin = tile.margins[TOP];
-
-					if (margin > bottommargin_of_toptile)
-						margin = bottommargin_of_toptile;
-
-					if (outer.right_bottom.y-1 != outer.left_top.y)
-						tile.margins[BOTTOM] = 0.;
-				}
-
-				for (int x = relevant_inner.left_top.x; x < relevant_inner.right_bottom.x; x++)
-				{
-					auto& tile = view.at(x, outer.left_top.y);
-					tile.margins[LEFT] = tile.margins[RIGHT] = 0.;
-				}
+				int y = outer.left_top.y;
+				lower_row(TOP, y, relevant_outer.left_top.x, relevant_outer.right_bottom.x, bottommargin_of_toptile);
+				if (multiple_rows)
+					lower_row(BOTTOM, y, relevant_outer.left_top.x, relevant_outer.right_bottom.x, 0);
+				lower_row(LEFT, y, relevant_inner.left_top.x, relevant_inner.right_bottom.x, 0);
+				lower_row(RIGHT, y, relevant_inner.left_top.x, relevant_inner.right_bottom.x, 0);
 			}
 
 			if (area.contains_y(outer.right_bottom.y-1))
 			{
-				for (int x = relevant_outer.left_top.x; x < relevant_outer.right_bottom.x; x++)
-				{
-					auto& tile = view.at(x, outer.right_bottom.y-1);
-					double& margin = tile.margins[BOTTOM];
-
-					if (margin > topmargin_of_bottomtile)
-						margin = topmargin_of_bottomtile;
-
-					if (outer.right_bottom.y-1 != outer.left_top.y)
-						tile.margins[TOP] = 0.;
-				}
-				
-				for (int x = relevant_inner.left_top.x; x < relevant_inner.right_bottom.x; x++)
-				{
-					auto& tile = view.at(x, outer.right_bottom.y-1);
-					tile.margins[LEFT] = tile.margins[RIGHT] = 0.;
-				}
+				int y = outer.right_bottom.y-1;
+				lower_row(BOTTOM, y, relevant_outer.left_top.x, relevant_outer.right_bottom.x, topmargin_of_bottomtile);
+				if (multiple_rows)
+					lower_row(TOP, y, relevant_outer.left_top.x, relevant_outer.right_bottom.x, 0);
+				lower_row(LEFT, y, relevant_inner.left_top.x, relevant_inner.right_bottom.x, 0);
+				lower_row(RIGHT, y, relevant_inner.left_top.x, relevant_inner.right_bottom.x, 0);
 			}
 
 			if (area.contains_x(outer.left_top.x))
 			{
-				for (int y = relevant_outer.left_top.y; y < relevant_outer.right_bottom.y; y++)
-				{
-					auto& tile = view.at(outer.left_top.x, y);
-					double& margin = tile.margins[LEFT];
-
-					if (margin > rightmargin_of_lefttile)
-						margin = rightmargin_of_lefttile;
-
-					if (outer.right_bottom.x-1 != outer.left_top.x)
-						tile.margins[RIGHT] = 0.;
-				}
-				
-				for (int y = relevant_inner.left_top.y; y < relevant_inner.right_bottom.y; y++)
-				{
-					auto& tile = view.at(outer.left_top.x, y);
-					tile.margins[TOP] = tile.margins[BOTTOM] = 0.;
-				}
+				int x = outer.left_top.x;
+				lower_column(LEFT, x, relevant_outer.left_top.y, relevant_outer.right_bottom.y, rightmargin_of_lefttile);
+				if (multiple_columns)
+					lower_column(RIGHT, x, relevant_outer.left_top.y, relevant_outer.right_bottom.y, 0);
+				lower_column(TOP, x, relevant_inner.left_top.y, relevant_inner.right_bottom.y, 0);
+				lower_column(BOTTOM, x, relevant_inner.left_top.y, relevant_inner.right_bottom.y, 0);
 			}
 
 			if (area.contains_x(outer.right_bottom.x-1))
 			{
-				for (int y = relevant_outer.left_top.y; y < relevant_outer.right_bottom.y; y++)
-				{
-					auto& tile = view.at(outer.right_bottom.x-1, y);
-					double& margin = tile.margins[RIGHT];
+				int x = outer.right_bottom.x-1;
+				lower_column(RIGHT, x, relevant_outer.left_top.y, relevant_outer.right_bottom.y, leftmargin_of_righttile);
+				if (multiple_columns)
+					lower_column(LEFT, x, relevant_outer.left_top.y, relevant_outer.right_bottom.y, 0);
+				lower_column(TOP, x, relevant_inner.left_top.y, relevant_inner.right_bottom.y, 0);
+				lower_column(BOTTOM, x, relevant_inner.left_top.y, relevant_inner.right_bottom.y, 0);
+			}
+		}
+	}
 
-					if (margin > leftmargin_of_righttile)
-						margin = leftmargin_of_righttile;
+	// copy the planes into walk_map, chunk by chunk
+	Pos first_chunk = Pos::tile_to_chunk(area.left_top);
+	Pos last_chunk = Pos::tile_to_chunk(area.right_bottom - Pos(1,1));
+	for (int chunk_x = first_chunk.x; chunk_x <= last_chunk.x; chunk_x++)
+		for (int chunk_y = first_chunk.y; chunk_y <= last_chunk.y; chunk_y++)
+		{
+			Chunk<pathfinding::walk_t>& chunk = *walk_map.get_chunk(chunk_x, chunk_y);
+			Area part = area.intersect(Area(Pos::chunk_to_tile(Pos(chunk_x, chunk_y)), Pos::chunk_to_tile(Pos(chunk_x+1, chunk_y+1))));
 
-					if (outer.right_bottom.x-1 != outer.left_top.x)
-						tile.margins[LEFT] = 0.;
-				}
-				
-				for (int y = relevant_inner.left_top.y; y < relevant_inner.right_bottom.y; y++)
+			for (int x = part.left_top.x; x < part.right_bottom.x; x++)
+				for (int y = part.left_top.y; y < part.right_bottom.y; y++)
 				{
-					auto& tile = view.at(outer.right_bottom.x-1, y);
-					tile.margins[TOP] = tile.margins[BOTTOM] = 0.;
+					size_t idx = size_t(y - area.left_top.y) * width + (x - area.left_top.x);
+					pathfinding::walk_t& tile = chunk[tileidx(x)][tileidx(y)];
+					for (int i=0; i<4; i++)
+						tile.margins[i] = pathfinding::margin_t::from_raw(planes[i][idx]);
 				}
-			}
 		}
-	}
+
+	pathfinder.invalidate(area);
 }
 
 void FactorioGame::assert_resource_consistency() const // only for debugging purposes
@@ -903,9 +1182,48 @@ void FactorioGame::assert_resource_consistency() const // only for debugging pur
 	#endif
 }
 
-void FactorioGame::parse_resources(const Area& area, const string& data)
+void FactorioGame::decode_resources(decoded_packet_t& packet) const
 {
+	Logger log("objects");
+
+	const Area& area = packet.area;
 	assert(area.size() == Pos(32,32));
+
+	auto add_resource = [&](Entity&& ent)
+	{
+		Resource::type_t type = resource_type_of(ent.proto);
+		Pos pos = ent.pos.to_int_floor();
+
+		if (!area.contains(pos))
+		{
+			// TODO FIXME
+			log << "wtf, " << pos.str() << " is not in "<< area.str() << endl;
+			return;
+		}
+
+		packet.resources.push_back({type, std::move(ent)});
+	};
+
+	if (packet.compact)
+	{
+		if (packet.data.size() % COMPACT_ENTITY_SIZE != 0)
+			throw runtime_error("parse_resources: invalid length");
+
+		for (size_t i=0; i<packet.data.size(); i+=COMPACT_ENTITY_SIZE)
+			add_resource(decode_compact_entity(packet.data.substr(i, COMPACT_ENTITY_SIZE), area.left_top));
+		return;
+	}
+
+	for (string_view entry : split_view(packet.data, ',')) if (!entry.empty())
+	{
+		auto [type_str,xx,yy] = unpack<string_view,double,double>(entry, ' ');
+		add_resource(Entity(Pos_f(xx,yy), &get_entity_prototype(type_str)));
+	}
+}
+
+void FactorioGame::apply_resources(decoded_packet_t& packet)
+{
+	const Area& area = packet.area;
 	Logger log("objects");
 	
 	auto view = resource_map.view(area.left_top - Pos(32,32), area.right_bottom + Pos(32,32), Pos(0,0));
@@ -916,28 +1234,16 @@ void FactorioGame::parse_resources(const Area& area, const string& data)
 		Entity entity = Entity(Entity::nullent_tag{});
 	} chunk[32][32] = {};
 
-	// parse all entities and write them to the WorldMap
-	for (string entry : split(data, ',')) if (entry!="")
+	// write all entities to the temporary chunk
+	for (auto& [type, entity] : packet.resources)
 	{
-		auto [type_str,xx,yy] = unpack<string,double,double>(entry, ' ');
-		
-		Resource::type_t type = Resource::types.at(type_str);
-		Pos pos = {int(floor(xx)), int(floor(yy))};
-
-		if (!area.contains(pos))
-		{
-			// TODO FIXME
-			log << "wtf, " << pos.str() << " is not in "<< area.str() << endl;
-			continue;
-		}
-
-		Pos relpos = pos - area.left_top;
+		Pos relpos = entity.pos.to_int_floor() - area.left_top;
 
 		if (chunk[relpos.y][relpos.x].type != Resource::NONE)
-			log << "wtf, " << pos.str() << " has a conflicting resource entry?! (broken packet?)" << endl;
+			log << "wtf, " << (relpos+area.left_top).str() << " has a conflicting resource entry?! (broken packet?)" << endl;
 
 		chunk[relpos.y][relpos.x].type = type;
-		chunk[relpos.y][relpos.x].entity = Entity(Pos_f(xx,yy), entity_prototypes.at(type_str).get());
+		chunk[relpos.y][relpos.x].entity = std::move(entity);
 	}
 
 	for (int x = area.left_top.x; x < area.right_bottom.x; x++)
@@ -22,10 +22,12 @@
 #include <memory>
 #include <unordered_map>
 #include <vector>
-#include <fstream>
+#include <string_view>
 #include <set>
+#include <bitset>
 
 #include "pathfinding.hpp"
+#include "pathfinder.hpp"
 #include "worldmap.hpp"
 #include "pos.hpp"
 #include "area.hpp"
@@ -40,30 +42,43 @@
 #include "defines.h"
 #include "graphics_definitions.h"
 #include "item_storage.h"
+#include "packet_reader.hpp"
+#include "prototype_index.hpp"
 
 class FactorioGame
 {
+	public:
+		/** counts what apply_objects() did with the entities */
+		struct object_stats_t
+		{
+			size_t kept = 0; // reported again, so their data was taken over
+			size_t added = 0; // new
+			size_t removed = 0; // not reported again (these stay pending for a while, in case they show up in another area), or explicitly removed
+			size_t expired = 0; // pending entities that did not show up again
+		};
+
 	private:
 		Rcon rcon;
 
-		std::string line_buffer;
-
 		std::string factorio_file_prefix;
-		std::ifstream factorio_file;
+		PacketReader factorio_file;
 		int factorio_file_id = 1;
 
 		void change_file_id(int new_id);
 		std::string factorio_file_name();
-		std::string remove_line_from_buffer();
 
 		double max_entity_radius = 0.;
 		std::unordered_map< std::string, std::unique_ptr<const EntityPrototype> > entity_prototypes;
 		std::unordered_map< std::string, std::unique_ptr<const ItemPrototype> > item_prototypes;
+		// the prototypes' ids are given in the order the mod sends them. The compact encoding refers to entity prototypes by these ids.
+		PrototypeIndex<EntityPrototype> entity_prototype_index;
+		PrototypeIndex<ItemPrototype> item_prototype_index;
+		std::vector<Resource::type_t> resource_types; // indexed by EntityPrototype::id
 		std::unordered_map< std::string, std::unique_ptr<const Recipe> > recipes;
 	
 	public:
-		WorldList<Entity, Entity::mostly_equals_comparator> actual_entities; // list of entities that are actually there per chunk
-		WorldList<DesiredEntity, Entity::mostly_equals_comparator> desired_entities; // list of entities that we expect to be there per chunk
+		WorldList<Entity, Entity::mostly_equals_comparator, Entity::mostly_equals_hash> actual_entities; // list of entities that are actually there per chunk
+		WorldList<DesiredEntity, Entity::mostly_equals_comparator, Entity::mostly_equals_hash> desired_entities; // list of entities that we expect to be there per chunk
 		
 		// the GraphicsDefinition has either one or four entries: north east south west.
 		std::unordered_map< std::string, std::vector<GraphicsDefinition> > graphics_definitions;
@@ -77,21 +92,62 @@ class FactorioGame
 		 *   - an entity was reconfigured by another player
 		 */
 
-		void parse_graphics(const std::string& data);
-		void parse_tiles(const Area& area, const std::string& data);
-		void parse_resources(const Area& area, const std::string& data);
-		void parse_entity_prototypes(const std::string& data);
-		void parse_item_prototypes(const std::string& data);
-		void parse_recipes(const std::string& data);
-		void parse_action_completed(const std::string& data);
-		void parse_players(const std::string& data);
-		void parse_objects(const Area& area, const std::string& data);
-		void parse_item_containers(const std::string& data);
+	public:
+		/** A packet that has been split into its fields, and whose per-chunk payload (for
+		  * tiles, resources and objects) has already been decoded into intermediate records.
+		  * `type` and `data` point into the raw packet, which must outlive this. */
+		struct decoded_packet_t
+		{
+			int tick = 0;
+			std::string_view type;
+			std::string_view data;
+			Area area;
+			bool compact = false; // data uses the compact encoding (see doc/factorio_comm.md)
+			uint64_t file_offset = 0; // in the output file, just past this packet. 0 if unknown.
+
+			std::bitset<1024> walkable; // for "tiles", indexed by y*32+x
+
+			struct resource_t
+			{
+				Resource::type_t type;
+				Entity entity;
+			};
+			std::vector<resource_t> resources; // for "resources"
+
+			std::vector<Entity> objects; // for "objects"
+		};
+
+	private:
+		void decode_compact_packet(std::string_view pkg, decoded_packet_t& packet) const;
+		Entity decode_compact_entity(std::string_view record, Pos left_top) const;
+		Entity decode_object_entry(std::string_view entry) const;
+		void decode_tiles(decoded_packet_t& packet) const;
+		void decode_resources(decoded_packet_t& packet) const;
+		void decode_objects(decoded_packet_t& packet) const;
+		void apply_tiles(const decoded_packet_t& packet);
+		void apply_resources(decoded_packet_t& packet);
+		void apply_objects(decoded_packet_t& packet);
+
+		void parse_graphics(std::string_view data);
+		void parse_entity_prototypes(std::string_view data);
+		void parse_item_prototypes(std::string_view data);
+		void parse_recipes(std::string_view data);
+		void parse_action_completed(std::string_view data);
+		void parse_players(std::string_view data);
+		/** sets the contents of the listed containers. If `delta` is true, only the listed item
+		  * amounts change (zero removes the item), instead of the whole contents. */
+		void parse_item_containers(std::string_view data, bool delta);
+		void parse_entity_added(std::string_view data);
+		void parse_entity_removed(std::string_view data);
+		/** recalculates the margins of the tiles in `area` from all entities that overlap it */
 		void update_walkmap(const Area& area);
-		void parse_mined_item(const std::string& data);
-		void parse_inventory_changed(const std::string& data);
+		void parse_mined_item(std::string_view data);
+		void parse_inventory_changed(std::string_view data);
 
 		void resolve_references_to_items();
+		/** called at STATIC_DATA_END. Builds the lookup tables for the prototypes, which from then on replace the string hashmaps. */
+		void intern_prototypes();
+		Resource::type_t resource_type_of(const EntityPrototype* proto) const;
 		
 		/** flood-fills the resource patch at (x,y), but only the part with a patch_id being
 		  * NOT_YET_ASSIGNED, generating a new ResourcePatch from it. Stops at already-assigned
@@ -107,6 +163,7 @@ class FactorioGame
 		void floodfill_resources(WorldMap<Resource>::Viewport& view, const Area& area /* FIXME remove the area parameter */, int x, int y, int radius);
 		int next_free_resource_id = 1;
 		int last_tick = 0;
+		uint64_t committed_file_offset = 0; // just past the last committed packet. This is where a snapshot resumes reading.
 
 
 		struct best_before_entity_t
@@ -114,7 +171,16 @@ class FactorioGame
 			int last_valid_tick;
 			Entity entity;
 		};
-		std::vector<best_before_entity_t> pending_entities;
+		// entities that are expected to show up in an objects packet soon, by Entity::mostly_equals_hash
+		typedef std::unordered_multimap<size_t, best_before_entity_t> pending_entities_t;
+		pending_entities_t pending_entities;
+		int pending_entities_cleanup_tick = 0; // when the timed out pending entities were last removed
+
+		object_stats_t object_stats_;
+
+		/** if `candidates` contains an entity that mostly_equals `ent`, moves its data to `ent` and
+		  * removes it from `candidates`. Its collision box is stored in `old_box`, if given. */
+		static bool take_over_data(pending_entities_t& candidates, Entity& ent, Area_f* old_box = nullptr);
 
 		/** changes the type of the resource-field 'entry' to new_type (which can be NONE, in which case
 		  * `entity` will be ignored). The resulting patch_id will always be NOT_YET_ASSIGNED.
@@ -129,12 +195,36 @@ class FactorioGame
 		void rcon_call(std::string func, std::string args);
 		void rcon_call(std::string func, int player_id, std::string args);
 		void rcon_call(std::string func, int action_id, int player_id, std::string args);
-		std::string read_packet();
+		/** returns the next packet, or an empty string_view if none is available yet.
+		  * The view is only valid until the next call to read_packet(). */
+		std::string_view read_packet();
+		/** returns the offset in the output file just past the packet last returned by read_packet() */
+		uint64_t read_position() const { return factorio_file.position(); }
 
-		/** parses a packet. returns true if this results in a consistent gamestate (i.e., on "tick" messages) */
-		bool parse_packet(const std::string& data);
+		/** parses a packet. returns true if this results in a consistent gamestate (i.e., on "tick" messages).
+		  * `pkg` is expected to be the packet last returned by read_packet(). */
+		bool parse_packet(std::string_view pkg);
+
+		/** first half of parse_packet(): splits the packet and decodes its per-chunk payload.
+		  * Does not modify the game state, so this may be called from any thread, as long as
+		  * no prototype packets are committed at the same time. */
+		decoded_packet_t decode_packet(std::string_view pkg) const;
+		/** second half of parse_packet(): applies a decoded packet to the game state. Packets must
+		  * be committed in the order they were read. Returns true on "tick" packets. */
+		bool commit_packet(decoded_packet_t&& packet);
 		int get_tick() { return last_tick; }
-		void register_pending_entity(int tick, const Entity& ent) { pending_entities.push_back({tick,ent}); }
+
+		/** writes walk_map, resource_map, resource_patches, actual_entities and players, together with
+		  * the position in the output file up to which they are valid, into a binary snapshot file.
+		  * The bot's own plans (desired_entities, player actions, item claims) are not saved. */
+		void save_snapshot(const std::string& filename) const;
+		/** replaces the world state by a snapshot written by save_snapshot(), and continues reading the
+		  * output file where the snapshot left off. Must be called right after STATIC_DATA_END.
+		  * Returns false (leaving everything untouched) if there is no snapshot, or if it does not match
+		  * the prototypes or the output file. Throws if the snapshot is corrupt. */
+		bool load_snapshot(const std::string& filename);
+		void register_pending_entity(int tick, const Entity& ent) { pending_entities.emplace(Entity::mostly_equals_hash()(ent), best_before_entity_t{tick,ent}); }
+		const object_stats_t& object_stats() const { return object_stats_; }
 
 		// never use these functions directly, use player actions instead
 		void set_waypoints(int action_id, int player_id, const std::vector<Pos>& waypoints);
@@ -149,6 +239,7 @@ class FactorioGame
 		void walk_to(int id, const Pos& dest);
 
 		WorldMap<pathfinding::walk_t> walk_map;
+		pathfinding::Pathfinder pathfinder{walk_map}; // for finding paths on walk_map
 		WorldMap<Resource> resource_map;
 		std::set< std::shared_ptr<ResourcePatch> > resource_patches;
 
@@ -157,8 +248,14 @@ class FactorioGame
 		
 		std::vector<Player> players;
 
-		const EntityPrototype& get_entity_prototype(std::string name) const { return *entity_prototypes.at(name); }
-		const ItemPrototype& get_item_prototype(std::string name) const { return *item_prototypes.at(name); }
+		/** these throw std::out_of_range for unknown names. After STATIC_DATA_END, they don't hash or allocate. */
+		const EntityPrototype& get_entity_prototype(std::string_view name) const;
+		const ItemPrototype& get_item_prototype(std::string_view name) const;
+		/** returns nullptr for unknown names. */
+		const EntityPrototype* find_entity_prototype(std::string_view name) const { return entity_prototype_index.find(name); }
+		/** prototype ids are dense, so per-prototype data can be stored in vectors of this size. */
+		size_t n_entity_prototypes() const { return entity_prototype_index.size(); }
+		size_t n_item_prototypes() const { return item_prototype_index.size(); }
 		const Recipe* get_recipe(std::string name) const { return recipes.at(name).get(); }
 
 		/** returns the best recipe for crafting the item */
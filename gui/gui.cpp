@@ -55,6 +55,7 @@
 #include <memory>
 #include <unordered_map>
 #include <array>
+#include <optional>
 
 using std::cout;
 using std::endl;
@@ -273,7 +274,7 @@ class _MapGui_impl
 		std::vector<rect_t> rects;
 
 		void load_graphics();
-		unordered_map<string, array<GameGraphic,4> > game_graphics;
+		vector< optional< array<GameGraphic,4> > > game_graphics; // indexed by EntityPrototype::id
 		
 		void tick(); // called 5 times per second (roughly)
 		int _key;
@@ -463,15 +464,12 @@ void MapBox::draw(void)
 
 				for (const auto& entity : entities)
 				{
-					// FIXME this should be a member of EntityPrototype to
-					// avoid the hashmap lookup
-
-					auto iter = gui->game_graphics.find(entity.proto->name);
-					if (iter != gui->game_graphics.end())
+					size_t id = entity.proto->id;
+					if (id < gui->game_graphics.size() && gui->game_graphics[id])
 					{
 						// we have a graphic for this entity
 						// FIXME use the proper direction, once we get it from the game
-						const GameGraphic& gfx = iter->second[entity.direction];
+						const GameGraphic& gfx = (*gui->game_graphics[id])[entity.direction];
 
 						Pos p = zoom_transform(entity.pos + gfx.shift, -zoom_level) + canvas_center + Pos(imgwidth/2, imgheight/2);
 						
@@ -736,11 +734,20 @@ string _MapGui_impl::gfx_filename(string orig)
 
 void _MapGui_impl::load_graphics()
 {
+	game_graphics.clear();
+	game_graphics.resize(game->n_entity_prototypes());
+
 	for (const auto& iter : game->graphics_definitions)
 	{
 		const string& name = iter.first;
 		const vector<GraphicsDefinition>& defs = iter.second;
-		array<GameGraphic,4>& game_graphic = game_graphics[name];
+
+		const EntityPrototype* proto = game->find_entity_prototype(name);
+		if (!proto)
+			continue;
+
+		optional< array<GameGraphic,4> >& slot = game_graphics[proto->id];
+		array<GameGraphic,4>& game_graphic = slot.emplace();
 
 		assert(defs.size() == 1 || defs.size() == 4);
 
@@ -769,7 +776,7 @@ void _MapGui_impl::load_graphics()
 		catch(std::runtime_error err)
 		{
 			cout << "failed to load image: " << err.what() << endl;
-			game_graphics.erase( game_graphics.find(name) );
+			slot.reset();
 		}
 	}
 }
@@ -0,0 +1,210 @@
+/*
+ * Copyright (c) 2017, 2018 Florian Jung
+ *
+ * This file is part of factorio-bot.
+ *
+ * factorio-bot is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License,
+ * version 3, as published by the Free Software Foundation.
+ *
+ * factorio-bot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with factorio-bot. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+#include "hub_fields.hpp"
+#include "logging.hpp"
+
+using namespace std;
+using namespace pathfinding;
+
+void HubFields::add_hub(const string& name, const Pos& pos, int radius)
+{
+	lock_guard<mutex> lock(hubs_mutex);
+	hub_t& hub = hubs[name];
+	hub.pos = pos;
+	hub.area = Area(pos - Pos(radius,radius), pos + Pos(radius+1,radius+1));
+	hub.field = field_t();
+}
+
+void HubFields::remove_hub(const string& name)
+{
+	lock_guard<mutex> lock(hubs_mutex);
+	hubs.erase(name);
+}
+
+void HubFields::invalidate(const Area& area)
+{
+	// the steps from a vertex depend on the tiles around it
+	Area affected = area.expand(2);
+
+	lock_guard<mutex> lock(hubs_mutex);
+	for (auto& [name, hub] : hubs)
+		if (hub.field.valid && hub.area.intersects(affected))
+		{
+			if (hub.field.changed.size() < MAX_CHANGED_AREAS)
+				hub.field.changed.push_back(affected.intersect(hub.area));
+			else
+				hub.field.valid = false;
+		}
+}
+
+void HubFields::clear()
+{
+	lock_guard<mutex> lock(hubs_mutex);
+	for (auto& [name, hub] : hubs)
+		hub.field = field_t();
+}
+
+const HubFields::field_t* HubFields::field(const WorldMap<walk_t>& map, const string& name) const
+{
+	lock_guard<mutex> lock(hubs_mutex);
+	auto it = hubs.find(name);
+	if (it == hubs.end())
+		return nullptr;
+	if (!it->second.field.valid)
+		compute(map, it->second, it->second.field);
+	else if (!it->second.field.changed.empty())
+		repair(map, it->second, it->second.field);
+	return &it->second.field;
+}
+
+void HubFields::compute(const WorldMap<walk_t>& map, const hub_t& hub, field_t& field)
+{
+	Logger log("pathfinding");
+	log << "computing the distance fields around " << hub.pos.str() << endl;
+
+	field.graph = make_unique<LocalGraph>(map, hub.area, PortalGraph::SIZE);
+
+	field.origin = hub.pos;
+	double best = numeric_limits<double>::infinity();
+	for (int x = -MAX_ORIGIN_OFFSET; x <= MAX_ORIGIN_OFFSET; x++)
+		for (int y = -MAX_ORIGIN_OFFSET; y <= MAX_ORIGIN_OFFSET; y++)
+		{
+			Pos pos = hub.pos + Pos(x,y);
+			if (hub.area.contains(pos) && field.graph->can_move(pos) && Pos(x,y).len() < best)
+			{
+				best = Pos(x,y).len();
+				field.origin = pos;
+			}
+		}
+	if (best > 0.)
+		log << "using " << field.origin.str() << " instead, because the hub is blocked" << endl;
+
+	field.to_hub = field.graph->distances({{field.origin, 0.f}}, true);
+	field.from_hub = field.graph->distances({{field.origin, 0.f}}, false);
+	field.to_border = field.graph->border_distance(field.to_hub);
+	field.from_border = field.graph->border_distance(field.from_hub);
+	field.changed.clear();
+	field.valid = true;
+}
+
+void HubFields::repair(const WorldMap<walk_t>& map, const hub_t& hub, field_t& field)
+{
+	// one area at a time, so that each repair only has to deal with the changes in its area
+	for (const Area& area : field.changed)
+	{
+		field.graph->update(map, area);
+
+		// the origin is only chosen anew if it has been blocked
+		if (!field.graph->can_move(field.origin))
+		{
+			compute(map, hub, field);
+			return;
+		}
+
+		field.graph->repair(field.to_hub, field.origin, area, true);
+		field.graph->repair(field.from_hub, field.origin, area, false);
+	}
+	field.to_border = field.graph->border_distance(field.to_hub);
+	field.from_border = field.graph->border_distance(field.from_hub);
+	field.changed.clear();
+}
+
+static optional<double> lookup(const LocalGraph& graph, const vector<float>& dist, const Pos& pos)
+{
+	if (!graph.area.contains(pos))
+		return nullopt;
+	float d = dist[graph.index(pos)];
+	if (d == numeric_limits<float>::infinity())
+		return nullopt;
+	return d;
+}
+
+optional<double> HubFields::distance_to(const WorldMap<walk_t>& map, const string& name, const Pos& pos) const
+{
+	const field_t* f = field(map, name);
+	if (!f)
+		return nullopt;
+	return lookup(*f->graph, f->to_hub, pos);
+}
+
+optional<double> HubFields::distance_from(const WorldMap<walk_t>& map, const string& name, const Pos& pos) const
+{
+	const field_t* f = field(map, name);
+	if (!f)
+		return nullopt;
+	return lookup(*f->graph, f->from_hub, pos);
+}
+
+vector<Pos> HubFields::path_to(const WorldMap<walk_t>& map, const string& name, const Pos& pos) const
+{
+	const field_t* f = field(map, name);
+	if (!f)
+		return {};
+	return smooth_path(f->graph->descend(f->to_hub, pos, true), map, PortalGraph::SIZE);
+}
+
+vector<Pos> HubFields::path_from(const WorldMap<walk_t>& map, const string& name, const Pos& pos) const
+{
+	const field_t* f = field(map, name);
+	if (!f)
+		return {};
+	return smooth_path(f->graph->descend(f->from_hub, pos, false), map, PortalGraph::SIZE);
+}
+
+optional<double> HubFields::distance_estimate(const WorldMap<walk_t>& map, const Pos& start, const Pos& end) const
+{
+	vector<string> names;
+	{
+		lock_guard<mutex> lock(hubs_mutex);
+		for (const auto& [name, hub] : hubs)
+			if (hub.area.contains(start) && hub.area.contains(end))
+				names.push_back(name);
+	}
+
+	optional<double> result;
+	for (const string& name : names)
+	{
+		const field_t* f = field(map, name);
+		auto from_start = lookup(*f->graph, f->from_hub, start);
+		auto from_end = lookup(*f->graph, f->from_hub, end);
+		auto to_start = lookup(*f->graph, f->to_hub, start);
+		auto to_end = lookup(*f->graph, f->to_hub, end);
+
+		// d(start,end) >= d(hub,end) - d(hub,start). The distance within the area that is subtracted
+		// is at least the real one, but the other one must be clamped, because the real path may
+		// leave the area. Likewise, d(start,end) >= d(start,hub) - d(end,hub).
+		const double inf = numeric_limits<double>::infinity();
+		if (from_start)
+		{
+			double bound = min(from_end.value_or(inf), f->from_border + f->graph->distance_to_outside(end));
+			if (bound < inf) // otherwise, there is no path at all, which is left to the pathfinding
+				result = max(result.value_or(0.), bound - *from_start);
+		}
+		if (to_end)
+		{
+			double bound = min(to_start.value_or(inf), f->graph->distance_to_outside(start) + f->to_border);
+			if (bound < inf)
+				result = max(result.value_or(0.), bound - *to_end);
+		}
+	}
+	return result;
+}
@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2017, 2018 Florian Jung
+ *
+ * This file is part of factorio-bot.
+ *
+ * factorio-bot is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License,
+ * version 3, as published by the Free Software Foundation.
+ *
+ * factorio-bot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with factorio-bot. If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+
+#include "portal_graph.hpp"
+#include "worldmap.hpp"
+#include "pos.hpp"
+#include "area.hpp"
+
+namespace pathfinding
+{
+	/** Precomputed walking distances around places that are visited over and over again, like the
+	  * facilities that need refueling. For each hub, a distance field holds the length of the
+	  * shortest path from every vertex within RADIUS to the hub, and one from the hub to every
+	  * vertex. Distances to or from a hub, and the paths themselves, can then be read off in
+	  * O(path length) instead of searching for them.
+	  *
+	  * The fields only consider paths that stay within the hub's area, and are only valid for
+	  * characters of width PortalGraph::SIZE. They are computed lazily. After invalidate(), the
+	  * fields of the hubs whose area contains changed tiles are repaired around the changes (see
+	  * LocalGraph::repair()) the next time they are needed, so that building something at a
+	  * facility does not recompute its fields. Like PortalGraph, lookups may happen from several
+	  * threads at once, but not concurrently with invalidate().
+	  */
+	class HubFields
+	{
+		public:
+			static constexpr int RADIUS = 96;
+			/** if the hub itself is blocked, e.g. by the entities it was placed at, the closest
+			  * vertex at most this far away is used instead */
+			static constexpr int MAX_ORIGIN_OFFSET = 8;
+			/** if more areas than this have changed since the fields were last used, they are
+			  * recomputed instead of repaired */
+			static constexpr size_t MAX_CHANGED_AREAS = 32;
+
+			/** registers a hub at `pos`, or moves it there if it already exists */
+			void add_hub(const std::string& name, const Pos& pos, int radius = RADIUS);
+			void remove_hub(const std::string& name);
+			bool has_hub(const std::string& name) const { return hubs.count(name) != 0; }
+
+			/** the length of the shortest path from `pos` to the hub, or nullopt if `pos` is outside
+			  * of the hub's area or can not reach it */
+			std::optional<double> distance_to(const WorldMap<walk_t>& map, const std::string& name, const Pos& pos) const;
+			/** the length of the shortest path from the hub to `pos`, like distance_to() */
+			std::optional<double> distance_from(const WorldMap<walk_t>& map, const std::string& name, const Pos& pos) const;
+
+			/** the path from `pos` to the hub, or from the hub to `pos`, like a_star() would return
+			  * it. Empty if there is none within the hub's area. */
+			std::vector<Pos> path_to(const WorldMap<walk_t>& map, const std::string& name, const Pos& pos) const;
+			std::vector<Pos> path_from(const WorldMap<walk_t>& map, const std::string& name, const Pos& pos) const;
+
+			/** returns a lower bound for the walking distance from `start` to `end`, using every hub
+			  * whose area contains both. The path from the hub to `end` is at most as long as the one
+			  * from the hub to `start` plus the walk from `start` to `end`, and likewise for the paths
+			  * to the hub, so their differences are lower bounds. The fields only know the paths within
+			  * the area, which may be longer than the real ones, so the distance from the hub to `end`
+			  * is clamped to the one to the border of the area plus the direct line from there (and
+			  * likewise for the one from `start` to the hub). Returns nullopt if there is no such hub. */
+			std::optional<double> distance_estimate(const WorldMap<walk_t>& map, const Pos& start, const Pos& end) const;
+
+			/** marks the fields of all hubs whose area contains tiles in `area` as outdated */
+			void invalidate(const Area& area);
+			/** marks all fields as outdated, but keeps the hubs */
+			void clear();
+
+		private:
+			struct field_t
+			{
+				bool valid = false;
+				std::vector<Area> changed; // that must be repaired before the field is used
+				Pos origin; // the walkable vertex closest to the hub
+				std::unique_ptr<LocalGraph> graph;
+				std::vector<float> to_hub;
+				std::vector<float> from_hub;
+				float to_border; // the distance from the closest vertex on the border of the area to the hub
+				float from_border; // and from the hub to the closest one
+			};
+
+			struct hub_t
+			{
+				Pos pos;
+				Area area;
+				mutable field_t field;
+			};
+
+			mutable std::mutex hubs_mutex;
+			std::unordered_map<std::string, hub_t> hubs;
+
+			/** returns the up-to-date field of the hub, or nullptr if there is no such hub */
+			const field_t* field(const WorldMap<walk_t>& map, const std::string& name) const;
+			static void compute(const WorldMap<walk_t>& map, const hub_t& hub, field_t& field);
+			static void repair(const WorldMap<walk_t>& map, const hub_t& hub, field_t& field);
+	};
+}
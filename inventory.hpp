@@ -321,6 +321,15 @@ struct MultiInventory
 		return container.insert(std::pair{ key_t{item,inv}, val });
 	}
 
+	/** sets the amount of `item` in `inv`, removing the entry if `val` is zero */
+	void set(inventory_t inv, const ItemPrototype* item, size_t val)
+	{
+		if (val == 0)
+			container.erase(key_t{item,inv});
+		else
+			container[key_t{item,inv}] = val;
+	}
+
 	void dump() const;
 	Inventory get_inventory(inventory_t type) const;
 	
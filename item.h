@@ -23,6 +23,7 @@
 
 struct ItemPrototype
 {
+	size_t id = 0; // dense, in the order the prototypes were received
 	std::string name;
 	std::string type;
 
@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2017, 2018 Florian Jung
+ *
+ * This file is part of factorio-bot.
+ *
+ * factorio-bot is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License,
+ * version 3, as published by the Free Software Foundation.
+ *
+ * factorio-bot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with factorio-bot. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "jump_table.hpp"
+
+using namespace std;
+using namespace pathfinding;
+
+void JumpTable::invalidate(const Area& area)
+{
+	// a vertex is clear depending on the tiles up to 2 tiles away. Whether a jump stops there
+	// depends on its neighbors, too. The runs only look at vertices in the same chunk.
+	Pos lefttop = Pos::tile_to_chunk(area.left_top - Pos(2,2));
+	Pos rightbot = Pos::tile_to_chunk_ceil(area.right_bottom + Pos(3,3));
+
+	lock_guard<mutex> lock(chunks_mutex);
+	for (int x = lefttop.x; x < rightbot.x; x++)
+		for (int y = lefttop.y; y < rightbot.y; y++)
+		{
+			auto it = chunks.find(Pos(x,y));
+			if (it != chunks.end())
+				it->second->valid = false;
+		}
+}
+
+void JumpTable::clear()
+{
+	lock_guard<mutex> lock(chunks_mutex);
+	chunks.clear();
+}
+
+const JumpTable::chunk_t& JumpTable::get_chunk(const WorldMap<walk_t>& map, const Pos& chunkpos) const
+{
+	lock_guard<mutex> lock(chunks_mutex);
+	unique_ptr<chunk_t>& chunk = chunks[chunkpos];
+	if (chunk == nullptr)
+		chunk = make_unique<chunk_t>();
+	if (!chunk->valid)
+		compute(map, chunkpos, *chunk);
+	return *chunk;
+}
+
+void JumpTable::compute(const WorldMap<walk_t>& map, const Pos& chunkpos, chunk_t& chunk)
+{
+	// we need to know which vertices are clear within the chunk and one vertex around it,
+	// which depends on the tiles within 3 tiles around the chunk.
+	Pos origin = Pos::chunk_to_tile(chunkpos);
+	auto view = map.view(origin - Pos(3,3), origin + Pos(35,35), origin - Pos(3,3));
+
+	// free[x][y]: tile origin+(x-3,y-3) is walkable with a margin of at least 0.5 everywhere
+	bool free[38][38];
+	for (int x = 0; x < 38; x++)
+		for (int y = 0; y < 38; y++)
+		{
+			const walk_t& tile = view.at(x,y);
+			free[x][y] = tile.can_walk;
+			for (const margin_t& margin : tile.margins)
+				if (margin.raw() < margin_t::ONE/2)
+					free[x][y] = false;
+		}
+
+	// clear[x][y]: vertex origin+(x-1,y-1) is clear, i.e. free[x..x+3][y..y+3] are.
+	bool free_4wide[34][38]; // free[x..x+3][y]
+	for (int x = 0; x < 34; x++)
+		for (int y = 0; y < 38; y++)
+			free_4wide[x][y] = free[x][y] && free[x+1][y] && free[x+2][y] && free[x+3][y];
+	bool clear[34][34];
+	for (int x = 0; x < 34; x++)
+		for (int y = 0; y < 34; y++)
+			clear[x][y] = free_4wide[x][y] && free_4wide[x][y+1] && free_4wide[x][y+2] && free_4wide[x][y+3];
+
+	for (int x = 0; x < 32; x++)
+		for (int y = 0; y < 32; y++)
+			chunk.clear[x][y] = clear[x+1][y+1];
+
+	// a straight jump in direction (dx,dy) stops at a vertex that is not clear, or that has a forced
+	// neighbor: a clear diagonal neighbor ahead, whose orthogonal neighbor is not clear. Count how
+	// many vertices can be passed before that, up to the chunk border.
+	const Pos dirs[4] = { Pos(0,-1), Pos(1,0), Pos(0,1), Pos(-1,0) }; // NORTH, EAST, SOUTH, WEST
+	for (int d = 0; d < 4; d++)
+	{
+		const Pos dir = dirs[d];
+		const Pos side(dir.y, dir.x); // perpendicular to dir
+		auto stops_at = [&](int x, int y) {
+			if (!clear[x][y])
+				return true;
+			for (int sign : {-1, 1})
+				if (!clear[x + sign*side.x][y + sign*side.y] && clear[x + dir.x + sign*side.x][y + dir.y + sign*side.y])
+					return true;
+			return false;
+		};
+
+		Chunk<uint8_t>& run = chunk.run[d];
+		// walk against dir, so that the vertex ahead has already been calculated
+		int x0 = dir.x > 0 ? 31 : 0, xstep = dir.x > 0 ? -1 : 1;
+		int y0 = dir.y > 0 ? 31 : 0, ystep = dir.y > 0 ? -1 : 1;
+		for (int i = 0, x = x0; i < 32; i++, x += xstep)
+			for (int j = 0, y = y0; j < 32; j++, y += ystep)
+			{
+				if (stops_at(x+1, y+1))
+					run[x][y] = 0;
+				else
+				{
+					int xnext = x + dir.x, ynext = y + dir.y;
+					bool next_inside = 0 <= xnext && xnext < 32 && 0 <= ynext && ynext < 32;
+					run[x][y] = uint8_t(1 + (next_inside ? run[xnext][ynext] : 0));
+				}
+			}
+	}
+
+	chunk.valid = true;
+}
@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2017, 2018 Florian Jung
+ *
+ * This file is part of factorio-bot.
+ *
+ * factorio-bot is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License,
+ * version 3, as published by the Free Software Foundation.
+ *
+ * factorio-bot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with factorio-bot. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <cstdint>
+
+#include "pathfinding.hpp"
+#include "worldmap.hpp"
+#include "pos.hpp"
+#include "area.hpp"
+#include "defines.h"
+
+namespace pathfinding
+{
+	/** Precomputed data for jump point search, see a_star_jps().
+	  *
+	  * A vertex (x,y) is "clear" if the 4x4 tiles around it, from (x-2,y-2) to (x+1,y+1), are
+	  * walkable and have all margins >= 0.5. Then every step between the vertex and its eight
+	  * neighbors, and between those neighbors, is possible for any character size <= 1. The
+	  * clear vertices form a uniform-cost grid, on which jump point search can skip over
+	  * everything that is not next to a non-clear vertex.
+	  *
+	  * For every vertex and straight direction, the table stores how far a jump may go without
+	  * stopping (JPS+), up to the chunk border. The chunks are computed lazily from the walk map,
+	  * and everything that depends on changed tiles must be invalidate()d. Lookups may happen
+	  * from several threads at once, but not concurrently with invalidate().
+	  */
+	class JumpTable
+	{
+		private:
+			struct chunk_t
+			{
+				bool valid = false;
+				Chunk<bool> clear;
+				// run[dir][x][y] is the number of vertices that a jump in direction dir can pass
+				// without stopping, starting at (x,y), until the chunk border.
+				std::array< Chunk<uint8_t>, 4 > run;
+			};
+
+		public:
+			/** Reads the table for one search, caching the chunk that was accessed last. */
+			class View
+			{
+				friend class JumpTable;
+				private:
+					const JumpTable* table;
+					const WorldMap<walk_t>* map;
+					mutable const chunk_t* cached_chunk = nullptr;
+					mutable Pos cached_chunkpos;
+
+					View(const JumpTable* table_, const WorldMap<walk_t>* map_) : table(table_), map(map_) {}
+
+				public:
+					/** returns how many vertices a straight jump in direction `dir` passes, starting
+					  * at `pos`, before it must stop or reaches the chunk border. This is 0 if the
+					  * jump must stop at `pos` because it is not clear or has a forced neighbor. */
+					int run(const Pos& pos, dir4_t dir) const { return chunk(pos).run[dir][tileidx(pos.x)][tileidx(pos.y)]; }
+					bool clear(const Pos& pos) const { return chunk(pos).clear[tileidx(pos.x)][tileidx(pos.y)]; }
+
+				private:
+					const chunk_t& chunk(const Pos& pos) const
+					{
+						Pos chunkpos = Pos::tile_to_chunk(pos);
+						if (cached_chunk == nullptr || chunkpos != cached_chunkpos)
+						{
+							cached_chunk = &table->get_chunk(*map, chunkpos);
+							cached_chunkpos = chunkpos;
+						}
+						return *cached_chunk;
+					}
+			};
+
+			/** `map` must be the map this table was computed from */
+			View view(const WorldMap<walk_t>& map) const { return View(this, &map); }
+
+			/** marks everything that depends on the tiles in `area` as outdated */
+			void invalidate(const Area& area);
+			/** forgets everything, e.g. because the whole walk map was replaced */
+			void clear();
+
+		private:
+			mutable std::mutex chunks_mutex;
+			mutable std::unordered_map< Pos, std::unique_ptr<chunk_t> > chunks;
+
+			/** returns the chunk at chunk coordinates `chunkpos`, (re)computing it if necessary */
+			const chunk_t& get_chunk(const WorldMap<walk_t>& map, const Pos& chunkpos) const;
+			static void compute(const WorldMap<walk_t>& map, const Pos& chunkpos, chunk_t& chunk);
+	};
+}
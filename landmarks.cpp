@@ -0,0 +1,277 @@
+/*
+ * Copyright (c) 2017, 2018 Florian Jung
+ *
+ * This file is part of factorio-bot.
+ *
+ * factorio-bot is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License,
+ * version 3, as published by the Free Software Foundation.
+ *
+ * factorio-bot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with factorio-bot. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+#include "landmarks.hpp"
+#include "logging.hpp"
+
+using namespace std;
+using namespace pathfinding;
+
+/** the distances in the tables are sums of floats, so they may be off by a tiny bit */
+constexpr double ROUNDING_SLACK = 0.01;
+
+static bool has_vertices(const Area& area)
+{
+	return area.left_top.x < area.right_bottom.x && area.left_top.y < area.right_bottom.y;
+}
+
+void Landmarks::tables_t::find_borders()
+{
+	from_border.clear();
+	to_border.clear();
+	for (size_t i = 0; i < landmarks.size(); i++)
+	{
+		from_border.push_back(graph.border_distance(from[i]));
+		to_border.push_back(graph.border_distance(to[i]));
+	}
+}
+
+Landmarks::Heuristic::Heuristic(shared_ptr<const tables_t> tables_, const Area_f& end_, double allowed_distance_)
+	: tables(tables_), end(end_), allowed_distance(allowed_distance_)
+{
+	goal_from.fill(numeric_limits<double>::infinity());
+	goal_to.fill(0.);
+	if (tables == nullptr)
+		return;
+
+	const LocalGraph& graph = tables->graph;
+	const size_t n = tables->landmarks.size();
+	Area goal_box = pathfinding::goal_box(end, allowed_distance);
+	for (int x = goal_box.left_top.x; x < goal_box.right_bottom.x; x++)
+		for (int y = goal_box.left_top.y; y < goal_box.right_bottom.y; y++)
+		{
+			Pos pos(x,y);
+			if (distance(pos, end) > allowed_distance)
+				continue;
+
+			// a path from the landmark to a goal vertex either stays within the area, or it
+			// reaches the border first and walks at least the direct line from there.
+			// Nothing is known about the way back from goal vertices outside of the area.
+			if (!graph.area.contains(pos))
+			{
+				for (size_t i = 0; i < n; i++)
+				{
+					goal_from[i] = min(goal_from[i], double(tables->from_border[i]));
+					goal_to[i] = numeric_limits<double>::infinity();
+				}
+				continue;
+			}
+
+			size_t idx = graph.index(pos);
+			double outside = graph.distance_to_outside(pos);
+			for (size_t i = 0; i < n; i++)
+			{
+				goal_from[i] = min({goal_from[i], double(tables->from[i][idx]), tables->from_border[i] + outside});
+				goal_to[i] = max(goal_to[i], double(tables->to[i][idx]));
+			}
+		}
+}
+
+double Landmarks::Heuristic::operator()(const Pos& pos) const
+{
+	double result = max(0., distance(pos, end) - allowed_distance);
+	if (tables == nullptr || !tables->graph.area.contains(pos))
+		return result;
+
+	const LocalGraph& graph = tables->graph;
+	size_t idx = graph.index(pos);
+	double outside = graph.distance_to_outside(pos);
+	for (size_t i = 0; i < tables->landmarks.size(); i++)
+	{
+		// d(v,t) >= d(L,t) - d(L,v). The distance from the landmark to `pos` within the area is
+		// at least the real one, so this stays a lower bound. If the landmark reaches `pos` but
+		// not the goal, then `pos` can not reach the goal either.
+		double from = tables->from[i][idx];
+		if (from < numeric_limits<double>::infinity())
+		{
+			if (goal_from[i] == numeric_limits<double>::infinity())
+				return numeric_limits<double>::infinity();
+			result = max(result, goal_from[i] - from - ROUNDING_SLACK);
+		}
+
+		// d(v,t) >= d(v,L) - d(t,L), likewise if the goal reaches the landmark, but `pos` does not
+		if (goal_to[i] < numeric_limits<double>::infinity())
+		{
+			double to = min(double(tables->to[i][idx]), outside + tables->to_border[i]);
+			if (to == numeric_limits<double>::infinity())
+				return numeric_limits<double>::infinity();
+			result = max(result, to - goal_to[i] - ROUNDING_SLACK);
+		}
+	}
+	return result;
+}
+
+void Landmarks::set_area(const Area& area_)
+{
+	lock_guard<mutex> lock(tables_mutex);
+	area = area_;
+	tables = nullptr;
+	changed.clear();
+	valid = false;
+}
+
+Area Landmarks::get_area() const
+{
+	lock_guard<mutex> lock(tables_mutex);
+	return area;
+}
+
+void Landmarks::invalidate(const Area& area_)
+{
+	// the steps from a vertex depend on the tiles around it
+	Area affected = area_.expand(2);
+
+	lock_guard<mutex> lock(tables_mutex);
+	if (!valid || !area.intersects(affected))
+		return;
+	if (changed.size() < MAX_CHANGED_AREAS)
+		changed.push_back(affected.intersect(area));
+	else
+		valid = false;
+}
+
+void Landmarks::clear()
+{
+	lock_guard<mutex> lock(tables_mutex);
+	tables = nullptr;
+	changed.clear();
+	valid = false;
+}
+
+shared_ptr<const Landmarks::tables_t> Landmarks::get_tables(const WorldMap<walk_t>& map) const
+{
+	lock_guard<mutex> lock(tables_mutex);
+	if (!has_vertices(area))
+		return nullptr;
+
+	if (!valid)
+	{
+		tables = compute(map, area);
+		valid = true;
+	}
+	else if (!changed.empty())
+	{
+		// searches that are still running keep the old tables
+		if (tables.use_count() > 1)
+			tables = make_shared<tables_t>(*tables);
+		repair(map, tables, changed);
+	}
+	changed.clear();
+	return tables;
+}
+
+Landmarks::Heuristic Landmarks::heuristic(const WorldMap<walk_t>& map, const Area_f& end, double allowed_distance) const
+{
+	return Heuristic(get_tables(map), end, allowed_distance);
+}
+
+vector<Pos> Landmarks::landmarks(const WorldMap<walk_t>& map) const
+{
+	auto tables = get_tables(map);
+	return tables ? tables->landmarks : vector<Pos>();
+}
+
+shared_ptr<Landmarks::tables_t> Landmarks::compute(const WorldMap<walk_t>& map, const Area& area)
+{
+	Logger log("pathfinding");
+
+	auto result = make_shared<tables_t>(map, area);
+	const LocalGraph& graph = result->graph;
+	auto view = map.view(area.left_top, area.right_bottom, Pos(0,0));
+
+	// the landmarks are placed on known land only, because everything else is walkable but unexplored
+	auto candidate = [&](const Pos& pos) { return view.at(pos).land() && graph.can_move(pos); };
+
+	// start with the candidate closest to the center
+	Pos center = area.center();
+	Pos first = center;
+	double best = numeric_limits<double>::infinity();
+	for (int x = area.left_top.x; x < area.right_bottom.x; x++)
+		for (int y = area.left_top.y; y < area.right_bottom.y; y++)
+			if ((Pos(x,y) - center).len() < best && candidate(Pos(x,y)))
+			{
+				best = (Pos(x,y) - center).len();
+				first = Pos(x,y);
+			}
+	if (best == numeric_limits<double>::infinity())
+	{
+		log << "no landmarks in " << area.str() << ", because there is no known land" << endl;
+		result->find_borders();
+		return result;
+	}
+
+	// the smallest distance from any landmark so far. The first landmark is the farthest one from the center.
+	vector<float> spread = graph.distances({{first, 0.f}}, false);
+
+	for (size_t i = 0; i < N_LANDMARKS; i++)
+	{
+		Pos landmark;
+		float farthest = -1.f;
+		for (int x = area.left_top.x; x < area.right_bottom.x; x++)
+			for (int y = area.left_top.y; y < area.right_bottom.y; y++)
+			{
+				float d = spread[graph.index(Pos(x,y))];
+				if (d != numeric_limits<float>::infinity() && d > farthest && candidate(Pos(x,y)))
+				{
+					farthest = d;
+					landmark = Pos(x,y);
+				}
+			}
+		if (farthest <= 0.f)
+			break; // everything reachable is a landmark already
+
+		result->landmarks.push_back(landmark);
+		result->from.push_back(graph.distances({{landmark, 0.f}}, false));
+		result->to.push_back(graph.distances({{landmark, 0.f}}, true));
+
+		const vector<float>& from = result->from.back();
+		for (size_t j = 0; j < spread.size(); j++)
+			spread[j] = min(spread[j], from[j]);
+	}
+	result->find_borders();
+
+	log << "placed " << result->landmarks.size() << " landmarks in " << area.str() << endl;
+	return result;
+}
+
+void Landmarks::repair(const WorldMap<walk_t>& map, shared_ptr<tables_t>& tables, const vector<Area>& changed)
+{
+	// one area at a time, so that each repair only has to deal with the changes in its area
+	for (const Area& area : changed)
+	{
+		tables->graph.update(map, area);
+
+		// the landmarks are only placed anew if one of them has been blocked
+		for (const Pos& landmark : tables->landmarks)
+			if (!tables->graph.can_move(landmark))
+			{
+				tables = compute(map, tables->graph.area);
+				return;
+			}
+
+		for (size_t i = 0; i < tables->landmarks.size(); i++)
+		{
+			tables->graph.repair(tables->from[i], tables->landmarks[i], area, false);
+			tables->graph.repair(tables->to[i], tables->landmarks[i], area, true);
+		}
+	}
+	tables->find_borders();
+}
@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2017, 2018 Florian Jung
+ *
+ * This file is part of factorio-bot.
+ *
+ * factorio-bot is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License,
+ * version 3, as published by the Free Software Foundation.
+ *
+ * factorio-bot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with factorio-bot. If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <array>
+#include <vector>
+#include <memory>
+#include <mutex>
+
+#include "pathfinding.hpp"
+#include "portal_graph.hpp"
+#include "worldmap.hpp"
+#include "pos.hpp"
+#include "area.hpp"
+
+namespace pathfinding
+{
+	/** Lower bounds for walking distances from precomputed distances to and from a few landmarks
+	  * (ALT: A*, landmarks, triangle inequality), see a_star_alt().
+	  *
+	  * If d(L,v) is the length of the shortest path from landmark L to v, then by the triangle
+	  * inequality, every path from v to t is at least d(L,t) - d(L,v) long, and likewise at least
+	  * d(v,L) - d(t,L). Landmarks behind a lake from the goal's point of view make this much
+	  * better than the direct line around lakes.
+	  *
+	  * The landmarks are spread over the area by repeatedly picking the walkable vertex farthest
+	  * away from all landmarks so far. Their distances are only computed within the area, so they
+	  * may be longer than the real ones, which can leave it. Where that matters, they are clamped:
+	  * a path from L to t that leaves the area is at least as long as the shortest one from L to
+	  * the border of the area plus the direct line from the border to t. They are only valid for
+	  * characters of width SIZE.
+	  *
+	  * Nothing is computed until set_area() is called. Then the tables are computed lazily, which
+	  * takes a while and 2*N_LANDMARKS floats per vertex. After invalidate(), they are repaired
+	  * around the changes (see LocalGraph::repair()) the next time they are needed, like
+	  * HubFields. Lookups may happen from several threads at once, and even concurrently with
+	  * invalidate(), because every Heuristic keeps the tables it started with.
+	  */
+	class Landmarks
+	{
+		public:
+			static constexpr int N_LANDMARKS = 16;
+			static constexpr double SIZE = 0.5;
+			/** a good half width for the area, e.g. around the base */
+			static constexpr int RADIUS = 256;
+			/** if more areas than this have changed since the tables were last used, they are
+			  * recomputed instead of repaired */
+			static constexpr size_t MAX_CHANGED_AREAS = 32;
+
+		private:
+			struct tables_t
+			{
+				LocalGraph graph;
+				std::vector<Pos> landmarks;
+				// per landmark, the distances from it to each vertex and from each vertex to it, indexed by graph.index()
+				std::vector< std::vector<float> > from;
+				std::vector< std::vector<float> > to;
+				// per landmark, the distance from it to the closest vertex on the border of the area, and from the closest one to it
+				std::vector<float> from_border;
+				std::vector<float> to_border;
+
+				tables_t(const WorldMap<walk_t>& map, const Area& area) : graph(map, area, SIZE) {}
+
+				/** sets from_border and to_border */
+				void find_borders();
+			};
+
+		public:
+			/** Computes lower bounds for the distance to one goal */
+			class Heuristic
+			{
+				friend class Landmarks;
+				private:
+					std::shared_ptr<const tables_t> tables;
+					Area_f end;
+					double allowed_distance;
+					// per landmark, a lower bound for the distance from it to the closest goal vertex, and
+					// an upper bound for the distance from the farthest goal vertex to it
+					std::array<double, N_LANDMARKS> goal_from;
+					std::array<double, N_LANDMARKS> goal_to;
+
+					Heuristic(std::shared_ptr<const tables_t> tables_, const Area_f& end_, double allowed_distance_);
+
+				public:
+					/** returns a lower bound for the length of any path from `pos` to the goal. This is
+					  * infinite if `pos` and the goal are in different parts of the map, e.g. because a
+					  * landmark can reach one but not the other. */
+					double operator()(const Pos& pos) const;
+			};
+
+			/** (re)places the landmarks within `area` the next time they are needed */
+			void set_area(const Area& area);
+			Area get_area() const;
+
+			/** returns the heuristic for paths into the disc around `end` with outer radius
+			  * `allowed_distance`, computing or repairing the tables if necessary. Without an area,
+			  * this is the direct line. */
+			Heuristic heuristic(const WorldMap<walk_t>& map, const Area_f& end, double allowed_distance) const;
+
+			/** the landmarks that are currently used, computing them if necessary */
+			std::vector<Pos> landmarks(const WorldMap<walk_t>& map) const;
+
+			/** notes that the tiles in `area` have changed */
+			void invalidate(const Area& area);
+			/** forgets everything, e.g. because the whole walk map was replaced */
+			void clear();
+
+		private:
+			mutable std::mutex tables_mutex;
+			mutable std::shared_ptr<tables_t> tables;
+			Area area; // has no vertices until set_area() is called
+			mutable std::vector<Area> changed; // that must be repaired before the tables are used
+			mutable bool valid = false;
+
+			std::shared_ptr<const tables_t> get_tables(const WorldMap<walk_t>& map) const;
+			static std::shared_ptr<tables_t> compute(const WorldMap<walk_t>& map, const Area& area);
+			static void repair(const WorldMap<walk_t>& map, std::shared_ptr<tables_t>& tables, const std::vector<Area>& changed);
+	};
+}
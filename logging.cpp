@@ -1,2 +1,2 @@
 #include "logging.hpp"
-std::vector<std::string> Logger::stack;
+thread_local std::vector<std::string> Logger::stack;
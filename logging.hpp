@@ -52,5 +52,5 @@ class Logger : private virtual prefixbuf, public std::ostream
 			return result + "." + tail;
 		}
 
-		static std::vector<std::string> stack;
+		static thread_local std::vector<std::string> stack; // every thread has its own topic stack
 };
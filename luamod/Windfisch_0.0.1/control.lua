@@ -56,13 +56,18 @@ client_local_data = nil -- DO NOT USE, will cause desyncs
 
 outfile="output1.txt"
 must_write_initstuff = true
+-- if true, tiles, resources and objects are written in the compact encoding described in
+-- doc/factorio_comm.md instead of as text. The bot understands both, text is easier to debug.
+use_compact_format = false
 last_tick_in_file = nil -- this is nil inbetween any "tick:"-message and a subsequent proper message
 last_tick = 0
 
-local todo_next_tick = {}
 local crafting_queue = {} -- array of lists. crafting_queue[character_idx] is a list
 local recent_item_additions   = {} -- recent_item_additions[character_index].{tick,itemlist,recipe?,action_id?}, itemlist = { {"foo",2}, {"bar",17} }
 local player_inventories = {} -- array of dicts ("itemname" -> amount)
+local entity_proto_ids = {} -- dict ("entityname" -> id), as used by the compact encoding. filled by writeout_entity_prototypes()
+local inventories_by_name = {} -- dict ("entityname" -> array of the inventory types its entities have)
+CONTAINER_SWEEP_PERIOD = 120 -- every tracked container is checked once in this many ticks
 
 function inventory_type_name(invtype, enttype)
 	local burner = {
@@ -219,21 +224,85 @@ function on_init()
 
 	global.n_clients = 1
 
+	init_container_tracking()
+
 	game.write_file(outfile, "", false)
 end
 
-function write_file(tick, data, donotupdate)
+-- this is kept in `global`, so that the deltas still refer to what the bot knows after a reload
+function init_container_tracking()
+	global.containers = {}
+	global.containers.tracked = {} -- array of entities with an inventory, checked round-robin by sweep_containers()
+	global.containers.reported = {} -- reported[unit_number] = { ["inventory name"] = { ["item"] = amount } }, as the bot knows it
+	global.containers.sweep_idx = 1
+end
+
+-- must not be called from on_load(), which may not write to `global`
+function container_tracking()
+	if global.containers == nil then -- a save from before the containers were tracked
+		init_container_tracking()
+	end
+	return global.containers
+end
+
+function write_initial_stuff_once()
 	if must_write_initstuff then
 		must_write_initstuff = false
 		writeout_initial_stuff()
 	end
+end
 
-	game.write_file(outfile, tick.." "..data, true)
+function write_file(tick, data, donotupdate)
+	write_line(tick, tick.." "..data, donotupdate)
+end
+
+function write_line(tick, line, donotupdate)
+	write_initial_stuff_once()
+
+	game.write_file(outfile, line, true)
 	if donotupdate ~= true then
 		last_tick_in_file = tick
 	end
 end
 
+local compact_digits = {}
+for i = 0,63 do
+	compact_digits[i] = string.char(48 + i) -- '0' to 'o'
+end
+
+-- encodes a nonnegative integer as n_digits base-64 digits, least significant first
+function compact_number(value, n_digits)
+	local digits = {}
+	for i = 1,n_digits do
+		local digit = value % 64
+		digits[i] = compact_digits[digit]
+		value = (value - digit) / 64
+	end
+	return table.concat(digits)
+end
+
+-- typechar is 'T'iles, 'R'esources or 'O'bjects. area must not be larger than 32x32.
+function write_compact(tick, typechar, area, payload)
+	local offset = 8388608 -- 2^23, because the coordinates may be negative
+	write_line(tick, "#"..typechar..compact_number(tick, 6)..
+		compact_number(area.left_top.x + offset, 4)..compact_number(area.left_top.y + offset, 4)..
+		compact_number(area.right_bottom.x - area.left_top.x, 2)..compact_number(area.right_bottom.y - area.left_top.y, 2)..
+		compact_number(#payload, 4)..payload.."\n")
+end
+
+local compact_dirs = { [defines.direction.north]=0, [defines.direction.east]=1, [defines.direction.south]=2, [defines.direction.west]=3 }
+
+-- prototype id, then x and y relative to the area's left_top in 1/256 tiles. the direction lives in the upper bits of x.
+function compact_entity(name, position, dir, area)
+	local x = math.floor((position.x - area.left_top.x) * 256 + 0.5)
+	local y = math.floor((position.y - area.left_top.y) * 256 + 0.5)
+	return compact_number(entity_proto_ids[name] * 4294967296 + ((compact_dirs[dir] or 0) * 16384 + x) * 65536 + y, 8)
+end
+
+function can_write_compact(area)
+	return use_compact_format and area.right_bottom.x - area.left_top.x <= 32 and area.right_bottom.y - area.left_top.y <= 32
+end
+
 
 function pos_str(pos)
 	if #pos ~= 2 then
@@ -468,8 +537,10 @@ end
 function writeout_entity_prototypes()
 	header = "entity_prototypes: "
 	lines = {}
+	entity_proto_ids = {}
 	for name, prot in pairs(game.entity_prototypes) do
 		if string.sub(name, 1, 8) ~= "DATA_RAW" then
+			entity_proto_ids[name] = #lines -- the bot numbers them in the order it receives them, starting at 0
 			local coll = ""
 			local mine_result = ""
 			if prot.collision_mask ~= nil then
@@ -684,9 +755,7 @@ function on_tick(event)
 		writeout_players(event.tick)
 	end
 
-	if event.tick % 120 == 0 then
-		writeout_item_containers(event.tick, game.surfaces['nauvis']) -- FIXME: trigger this upon actual chest changes!
-	end
+	sweep_containers(event.tick)
 
 	-- periodically update the objects around the player to ensure that nothing is missed
 	-- This is merely a safety net and SHOULD be unnecessary, if all other updates don't miss anything
@@ -705,14 +774,6 @@ function on_tick(event)
 		end
 	end
 
-	if #todo_next_tick > 0 then
-		print("on_tick executing "..#todo_next_tick.." stored callbacks")
-		for _,func in ipairs(todo_next_tick) do
-			func()
-		end
-		todo_next_tick = {}
-	end
-
 	if last_tick_in_file ~= nil then
 		write_file(event.tick, "tick: \n", true)
 		last_tick_in_file = nil
@@ -809,6 +870,28 @@ end
 
 function writeout_tiles(tick, surface, area) -- SLOW! beastie can do ~2.8 per tick
 	--if my_client_id ~= 1 then return end
+	if can_write_compact(area) then
+		-- a bitmap of obstructed tiles, six per digit
+		local digits = {}
+		local bits = 0
+		local weight = 1
+		for y = area.left_top.y, area.right_bottom.y-1 do
+			for x = area.left_top.x, area.right_bottom.x-1  do
+				if surface.get_tile(x,y).collides_with('player-layer') then bits = bits + weight end
+				weight = weight * 2
+				if weight == 64 then
+					table.insert(digits, compact_digits[bits])
+					bits = 0
+					weight = 1
+				end
+			end
+		end
+		if weight ~= 1 then table.insert(digits, compact_digits[bits]) end
+
+		write_compact(tick, "T", area, table.concat(digits))
+		return
+	end
+
 	local header = "tiles "..area.left_top.x..","..area.left_top.y..";"..area.right_bottom.x..","..area.right_bottom.y..": "
 	
 	local tile = nil
@@ -825,6 +908,16 @@ end
 
 function writeout_resources(tick, surface, area) -- quite fast. beastie can do > 40, up to 75 per tick
 	--if my_client_id ~= 1 then return end
+	if can_write_compact(area) then
+		write_initial_stuff_once() -- for entity_proto_ids
+		local records = {}
+		for idx, ent in pairs(surface.find_entities_filtered{area=area, type='resource'}) do
+			table.insert(records, compact_entity(ent.name, ent.position, defines.direction.north, area))
+		end
+		write_compact(tick, "R", area, table.concat(records))
+		return
+	end
+
 	header = "resources "..area.left_top.x..","..area.left_top.y..";"..area.right_bottom.x..","..area.right_bottom.y..": "
 	line = ''
 	lines={}
@@ -855,95 +948,225 @@ function direction_str(d)
 	end
 end
 
+-- whether `ent` is reported in objects packets
+function is_object(ent)
+	return ent.prototype.collision_mask ~= nil and (ent.prototype.collision_mask['player-layer'] or ent.prototype.collision_mask['object-layer'])
+end
+
+function is_pipelike(ent)
+	return ent.type == "pipe" or ent.type == "wall" or ent.type == "heat-pipe"
+end
+
+local function count_except(entities, ignored)
+	local n = 0
+	for _, e in ipairs(entities) do
+		if e ~= ignored then n = n + 1 end
+	end
+	return n
+end
+
+-- returns the direction that is reported for `ent`, pretending that `ignored` (if given) does not exist anymore
+function object_direction(surface, ent, ignored)
+	if not is_pipelike(ent) then
+		return ent.direction
+	end
+
+	-- HACK to render pipes/walls etc correctly *most* of the time. (at least for straight parts)
+	-- this requires to report neighboring entities as well whenever a pipe/wall etc is placed, because adjacent things might change their
+	-- direction as well
+	local n_horiz = 0
+	local n_vert = 0
+	local x = ent.position.x
+	local y = ent.position.y
+	for _, t in ipairs({ent.type, ent.type.."-to-ground"}) do
+		n_horiz = n_horiz + count_except(surface.find_entities_filtered{type=t, position={x=x+1, y=y}}, ignored)
+		n_horiz = n_horiz + count_except(surface.find_entities_filtered{type=t, position={x=x-1, y=y}}, ignored)
+		n_vert  = n_vert  + count_except(surface.find_entities_filtered{type=t, position={x=x, y=y+1}}, ignored)
+		n_vert  = n_vert  + count_except(surface.find_entities_filtered{type=t, position={x=x, y=y-1}}, ignored)
+	end
+
+	if n_horiz > n_vert then
+		return defines.direction.east
+	else
+		return defines.direction.north
+	end
+end
+
+function object_str(ent, dir)
+	return ent.name.." "..ent.position.x.." "..ent.position.y.." "..direction_str(dir)
+end
+
 function writeout_objects(tick, surface, area)
 	--if my_client_id ~= 1 then return end
+	local compact = can_write_compact(area)
+	if compact then
+		write_initial_stuff_once() -- for entity_proto_ids
+	end
+
 	header = "objects "..area.left_top.x..","..area.left_top.y..";"..area.right_bottom.x..","..area.right_bottom.y..": "
 	line = ''
 	lines={}
+	local container_records = {}
 	for idx, ent in pairs(surface.find_entities(area)) do
 		if area.left_top.x <= ent.position.x and ent.position.x < area.right_bottom.x and area.left_top.y <= ent.position.y and ent.position.y < area.right_bottom.y then
-			if ent.prototype.collision_mask ~= nil and (ent.prototype.collision_mask['player-layer'] or ent.prototype.collision_mask['object-layer']) then
-				local dir
-				if ent.type == "pipe" or ent.type == "wall" or ent.type == "heat-pipe" then
-					-- HACK to render pipes/walls etc correctly *most* of the time. (at least for straight parts)
-					-- this requires writeout_objects of neighboring entities whenever a pipe/wall etc is placed, because adjacent things might change their
-					-- direction as well
-					local n_horiz = 0
-					local n_vert = 0
-					n_horiz = n_horiz + #surface.find_entities_filtered{type=ent.type, position={x=ent.position.x+1, y=ent.position.y}}
-					n_horiz = n_horiz + #surface.find_entities_filtered{type=ent.type, position={x=ent.position.x-1, y=ent.position.y}}
-					n_horiz = n_horiz + #surface.find_entities_filtered{type=ent.type.."-to-ground", position={x=ent.position.x+1, y=ent.position.y}}
-					n_horiz = n_horiz + #surface.find_entities_filtered{type=ent.type.."-to-ground", position={x=ent.position.x-1, y=ent.position.y}}
-					n_vert  = n_vert  + #surface.find_entities_filtered{type=ent.type, position={x=ent.position.x, y=ent.position.y+1}}
-					n_vert  = n_vert  + #surface.find_entities_filtered{type=ent.type, position={x=ent.position.x, y=ent.position.y-1}}
-					n_vert  = n_vert  + #surface.find_entities_filtered{type=ent.type.."-to-ground", position={x=ent.position.x, y=ent.position.y+1}}
-					n_vert  = n_vert  + #surface.find_entities_filtered{type=ent.type.."-to-ground", position={x=ent.position.x, y=ent.position.y-1}}
-
-					if n_horiz > n_vert then
-						dir = defines.direction.east
-					else
-						dir = defines.direction.north
-					end
-				else
-					dir = ent.direction
-				end
+			if is_object(ent) then
+				local dir = object_direction(surface, ent)
+				track_container(ent, container_records)
 
-				line=line..","..ent.name.." "..ent.position.x.." "..ent.position.y.." "..direction_str(dir)
-				if idx % 100 == 0 then
-					table.insert(lines,line)
-					line=''
+				if compact then
+					table.insert(lines, compact_entity(ent.name, ent.position, dir, area))
+				else
+					line=line..","..object_str(ent, dir)
+					if idx % 100 == 0 then
+						table.insert(lines,line)
+						line=''
+					end
 				end
 			end
 		end
 	end
-	table.insert(lines,line)
-	write_file(tick, header..table.concat(lines,"").."\n")
+
+	if compact then
+		write_compact(tick, "O", area, table.concat(lines))
+	else
+		table.insert(lines,line)
+		write_file(tick, header..table.concat(lines,"").."\n")
+	end
+
+	-- must come after the objects, so that the bot knows the containers
+	write_container_records(tick, container_records)
 
 	line=nil
 end
 
-function writeout_item_containers(tick, surface)
-	header = "item_containers: " -- fixme: only writeout per area
-	line = ''
-	lines={}
-	
-	local i=defines.inventory
-	local inventory_types = { 1,2,3,4,5,6,7,8 } -- FIXME HACK
-
-	-- TODO FIXME this is inefficient as hell
-	for idx, ent in pairs(surface.find_entities()) do
-		--if area.left_top.x <= ent.position.x and ent.position.x < area.right_bottom.x and area.left_top.y <= ent.position.y and ent.position.y < area.right_bottom.y then
-		if ent.name ~= "player" then
-			local has_inventory = false
+-- the pipes, walls etc next to `ent`, whose direction depends on `ent`'s existence
+function pipelike_neighbors(ent)
+	local base_type = ent.type:gsub("%-to%-ground$", "")
+	if base_type ~= "pipe" and base_type ~= "wall" and base_type ~= "heat-pipe" then
+		return {}
+	end
 
-			local inventory_strings = {}
+	local result = {}
+	local x = ent.position.x
+	local y = ent.position.y
+	for _, pos in ipairs({{x=x+1, y=y}, {x=x-1, y=y}, {x=x, y=y+1}, {x=x, y=y-1}}) do
+		for _, neighbor in ipairs(ent.surface.find_entities_filtered{type=base_type, position=pos}) do
+			table.insert(result, neighbor)
+		end
+	end
+	return result
+end
 
-			for _,inventory_type in ipairs(inventory_types) do
-				local inv = ent.get_inventory(inventory_type)
-				if inv ~= nil then
-					has_inventory = true
-					local inventory_content = {}
-					for item,amount in pairs(inv.get_contents()) do
-						table.insert(inventory_content, item..":"..amount)
-					end
-					table.insert(inventory_strings, inventory_type_name(inventory_type, ent.type).."="..table.concat(inventory_content, "%"))
+-- returns the inventory types that `ent` has. This only depends on the prototype, so it is cached.
+function inventories_of(ent)
+	local result = inventories_by_name[ent.name]
+	if result == nil then
+		result = {}
+		if ent.name ~= "player" then
+			for inventory_type = 1, 8 do -- FIXME HACK
+				if ent.get_inventory(inventory_type) ~= nil then
+					table.insert(result, inventory_type)
 				end
 			end
+		end
+		inventories_by_name[ent.name] = result
+	end
+	return result
+end
 
-			if has_inventory then
-				line=line..","..ent.name.." "..ent.position.x.." "..ent.position.y.." "..table.concat(inventory_strings,"+")
-
-				if idx % 100 == 0 then
-					table.insert(lines,line)
-					line=''
-				end
+-- returns an item_container_delta record with the items of `ent` whose amount has changed since
+-- they were last reported (an amount of 0 means that the item is gone), or nil if nothing has changed.
+-- If `full` is set, returns an item_containers record with all inventories and items instead.
+function container_record(ent, full)
+	local reported = (not full and container_tracking().reported[ent.unit_number]) or {}
+	local current = {}
+	local inventory_strings = {}
+
+	for _, inventory_type in ipairs(inventories_of(ent)) do
+		local name = inventory_type_name(inventory_type, ent.type)
+		local contents = ent.get_inventory(inventory_type).get_contents()
+		local old = reported[name] or {}
+
+		local changes = {}
+		for item, amount in pairs(contents) do
+			if old[item] ~= amount then
+				table.insert(changes, item..":"..amount)
+			end
+		end
+		for item, _ in pairs(old) do
+			if contents[item] == nil then
+				table.insert(changes, item..":0")
 			end
 		end
+
+		if full or #changes > 0 then
+			table.insert(inventory_strings, name.."="..table.concat(changes, "%"))
+		end
+		current[name] = contents
 	end
-	table.insert(lines,line)
-	write_file(tick, header..table.concat(lines,"").."\n")
 
-	line=nil
+	container_tracking().reported[ent.unit_number] = current
+	if #inventory_strings == 0 then return nil end
+	return ent.name.." "..ent.position.x.." "..ent.position.y.." "..table.concat(inventory_strings, "+")
+end
+
+-- starts tracking `ent`, if it has an inventory, and appends its full contents to `records`.
+-- This happens whenever `ent` is (re)reported to the bot, which then replaces whatever it
+-- remembers about the entity's contents, e.g. from a snapshot.
+function track_container(ent, records)
+	if ent.unit_number == nil or #inventories_of(ent) == 0 then return end
+
+	if container_tracking().reported[ent.unit_number] == nil then
+		table.insert(container_tracking().tracked, ent)
+	end
+	table.insert(records, container_record(ent, true))
+end
+
+function write_container_records(tick, records)
+	if #records > 0 then
+		write_file(tick, "item_containers: "..table.concat(records, ",").."\n")
+	end
+end
+
+function write_container_deltas(tick, records)
+	if #records > 0 then
+		write_file(tick, "item_container_delta: "..table.concat(records, ",").."\n")
+	end
+end
+
+-- reports the changes of `ent`'s inventories right away, e.g. after something was inserted
+function report_container(tick, ent)
+	if container_tracking().reported[ent.unit_number] == nil then return end
+	write_container_deltas(tick, {container_record(ent, false)})
+end
+
+-- checks a part of the tracked containers for changes, so that each of them is checked once per
+-- CONTAINER_SWEEP_PERIOD. This catches everything that is not reported by events, e.g. furnaces
+-- consuming fuel and producing plates.
+function sweep_containers(tick)
+	local c = container_tracking()
+	local n = math.ceil(#c.tracked / CONTAINER_SWEEP_PERIOD)
+	local records = {}
+
+	for _ = 1, n do
+		if c.sweep_idx > #c.tracked then
+			if #c.tracked == 0 then break end
+			c.sweep_idx = 1
+		end
+
+		local ent = c.tracked[c.sweep_idx]
+		if ent.valid then
+			local record = container_record(ent, false)
+			if record then table.insert(records, record) end
+			c.sweep_idx = c.sweep_idx + 1
+		else
+			-- the entity is gone; on_some_entity_deleted() has already forgotten its contents
+			c.tracked[c.sweep_idx] = c.tracked[#c.tracked]
+			c.tracked[#c.tracked] = nil
+		end
+	end
+
+	write_container_deltas(tick, records)
 end
 
 function rangestr(area)
@@ -996,32 +1219,44 @@ function on_some_entity_created(event)
 		return
 	end
 
-	if ent.type == "pipe" or ent.type == "pipe-to-ground" or ent.type == "wall" or ent.type == "heat-pipe" then -- HACK to semi-correctly assign an orientation to pipes etc
-		-- need to write out neighboring entities as well, because they might have changed their orientation by this event
-		writeout_objects(event.tick, ent.surface, {left_top={x=math.floor(ent.position.x)-1, y=math.floor(ent.position.y)-1}, right_bottom={x=math.floor(ent.position.x)+2, y=math.floor(ent.position.y)+2}})
-	else
-		writeout_objects(event.tick, ent.surface, {left_top={x=math.floor(ent.position.x), y=math.floor(ent.position.y)}, right_bottom={x=math.floor(ent.position.x)+1, y=math.floor(ent.position.y)+1}})
+	complain("on_some_entity_created: "..ent.name.." at "..ent.position.x..","..ent.position.y)
+	if not is_object(ent) then return end
+
+	-- an already known entity (e.g. a rotated one) is updated by the bot
+	local records = { object_str(ent, object_direction(ent.surface, ent)) }
+	for _, neighbor in ipairs(pipelike_neighbors(ent)) do
+		table.insert(records, object_str(neighbor, object_direction(ent.surface, neighbor)))
 	end
+	write_file(event.tick, "entity_added: "..table.concat(records, ",").."\n")
 
-	complain("on_some_entity_created: "..ent.name.." at "..ent.position.x..","..ent.position.y)
+	local container_records = {}
+	track_container(ent, container_records)
+	write_container_records(event.tick, container_records)
 end
 
 function on_some_entity_deleted(event)
 	local ent = event.entity
 	if ent == nil then
-		complain("wtf, on_some_entity_created has nil entity")
+		complain("wtf, on_some_entity_deleted has nil entity")
 		return
 	end
 
-	-- we can't do this now, because the entity still exists at this point. instead, we schedule the writeout for the next tick
-	
-	local surface = ent.surface
-	local area = {left_top={x=math.floor(ent.position.x), y=math.floor(ent.position.y)}, right_bottom={x=math.floor(ent.position.x)+1, y=math.floor(ent.position.y)+1}}
-	local tick = event.tick
-
-	table.insert(todo_next_tick, function () writeout_objects(tick, surface, area ) end)
-	
 	complain("on_some_entity_deleted: "..ent.name.." at "..ent.position.x..","..ent.position.y)
+	if not is_object(ent) then return end
+
+	-- the entity still exists at this point, so it must be ignored when turning its neighbors
+	write_file(event.tick, "entity_removed: "..object_str(ent, ent.direction).."\n")
+	if ent.unit_number ~= nil then
+		container_tracking().reported[ent.unit_number] = nil
+	end
+
+	local records = {}
+	for _, neighbor in ipairs(pipelike_neighbors(ent)) do
+		table.insert(records, object_str(neighbor, object_direction(ent.surface, neighbor, ent)))
+	end
+	if #records > 0 then
+		write_file(event.tick, "entity_added: "..table.concat(records, ",").."\n")
+	end
 end
 
 function on_player_crafted_item(event)
@@ -1272,6 +1507,8 @@ function rcon_insert_to_inventory(player_id, entity_name, entity_pos, inventory_
 		if check_n ~= real_n then
 			complain("wtf, tried to take "..real_n.."x "..items.name.." from player #"..player_id.." but only got "..check_n..". Isn't supposed to happen?!")
 		end
+
+		report_container(game.tick, entity)
 	end
 end
 function rcon_remove_from_inventory(player_id, entity_name, entity_pos, inventory_type, items)
@@ -1302,6 +1539,8 @@ function rcon_remove_from_inventory(player_id, entity_name, entity_pos, inventor
 		if check_n ~= real_n then
 			complain("wtf, couldn't insert "..real_n.."x "..items.name.." into player #"..player_id..", but only "..check_n..". dropping them :(.")
 		end
+
+		report_container(game.tick, entity)
 	end
 end
 
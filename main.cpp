@@ -20,6 +20,7 @@
 #include <climits>
 #include <cassert>
 #include "factorio_io.h"
+#include "packet_pipeline.hpp"
 #include "scheduler.hpp"
 #include "gui/gui.h"
 #include "goal.hpp"
@@ -117,7 +118,8 @@ static start_mines_t find_start_mines(FactorioGame* game, GUI::MapGui* gui, Pos_
 						water_size = resview.at(Pos(x,y)+p).resource_patch.lock()->size();
 					}
 
-				if (n_water == 1 && water_size > 100)
+				// the water must be reachable from the start position
+				if (n_water == 1 && water_size > 100 && game->pathfinder.same_region(pos.to_int(), Pos(x,y)))
 					watersources.insert( watersource_t{Pos(x,y)} );
 			}
 	
@@ -261,6 +263,8 @@ static void debug_draw_actions(const action::ActionBase* action, GUI::MapGui* gu
 }
 
 
+static constexpr int SNAPSHOT_INTERVAL = 60*60; // in ticks, i.e. once per minute of game time
+
 int main(int argc, const char** argv)
 {
 	if (argc != 3 && argc != 6)
@@ -270,6 +274,8 @@ int main(int argc, const char** argv)
 		cout << "       The rcon options can be left out. In this case, the bot is observe-only." << endl;
 		cout << "       This can be useful for debugging, since Factorio doesn't even need to run. It is" << endl;
 		cout << "       sufficient to read a previously generated outfile. " << endl;
+		cout << "       The world model is periodically saved to '<outfile-prefix>snapshot.bin', and restored" << endl;
+		cout << "       from there on the next start. Delete that file to re-read the outfile from the start." << endl;
 		return 1;
 	}
 
@@ -278,14 +284,18 @@ int main(int argc, const char** argv)
 	cout << "reading static data" << endl;
 	while(true)
 	{
-		string packet = factorio.read_packet();
+		string_view packet = factorio.read_packet();
+		factorio.parse_packet(packet);
 		if (packet == "0 STATIC_DATA_END")
 			break;
-		else
-			factorio.parse_packet(packet);
 	}
 	cout << "done reading static data" << endl;
 
+	// resume from the last snapshot instead of re-parsing the whole output file, if possible
+	const string snapshot_file = string(argv[1]) + "snapshot.bin";
+	factorio.load_snapshot(snapshot_file);
+	int last_snapshot_tick = factorio.get_tick();
+
 	goal::GoalList test_goals;
 	{
 		test_goals.push_back( make_unique<goal::PlaceEntity>(Entity(Pos(1,1), &factorio.get_entity_prototype("assembling-machine-1"))) );
@@ -330,11 +340,15 @@ int main(int argc, const char** argv)
 
 	GUI::MapGui gui(&factorio, argv[2]);
 
+	// from now on, the packets are read and decoded in background threads, and only committed to
+	// the game state here. Do not call factorio.read_packet() directly any more.
+	PacketPipeline pipeline(&factorio);
+
 	// quick read first part of the file before doing any GUI work. Useful for debugging, since reading in 6000 lines will take more than 6 seconds.
 	for (int i=0; i<6000; i++) 
 	{
 		//cout << i << endl;
-		factorio.parse_packet(factorio.read_packet());
+		pipeline.commit(1, true);
 	}
 	
 	size_t player_idx = SIZE_MAX;
@@ -584,6 +598,20 @@ int main(int argc, const char** argv)
 				facility_t("copper", plan_early_smelter_rig(*start_mines.copper, game)),
 				facility_t("stone", plan_early_chest_rig(*start_mines.stone, game)) }
 		{
+			// the facilities are revisited all the time for refueling and collecting their output
+			for (const auto& facility : facilities)
+				if (!facility.entities.empty())
+				{
+					Pos_f center(0.,0.);
+					for (const auto& ent : facility.entities)
+						center = center + ent.pos;
+					game->pathfinder.add_hub(facility.name, (center / double(facility.entities.size())).to_int());
+				}
+
+			// most walks are around the base, and the landmarks help with the lakes there
+			const int r = pathfinding::Landmarks::RADIUS;
+			Pos base = game->players[player_idx].position.to_int();
+			game->pathfinder.set_landmark_area(Area(base - Pos(r,r), base + Pos(r,r)));
 		}
 		
 		// create some initial tasks
@@ -749,7 +777,8 @@ int main(int argc, const char** argv)
 
 	while (true)
 	{
-		bool consistent_state = factorio.parse_packet( factorio.read_packet() );
+		// commit everything that has been decoded up to the next "tick", but don't starve the GUI
+		bool consistent_state = pipeline.commit(256);
 		frame++;
 		//cout << "frame " << frame << endl; if (frame>1000) break; // useful for profiling with gprof / -pg option, since we must cleanly exit then (not by ^C)
 		
@@ -758,6 +787,12 @@ int main(int argc, const char** argv)
 		if (!consistent_state)
 			continue;
 
+		if (factorio.get_tick() >= last_snapshot_tick + SNAPSHOT_INTERVAL)
+		{
+			factorio.save_snapshot(snapshot_file);
+			last_snapshot_tick = factorio.get_tick();
+		}
+
 		for (auto& player : factorio.players)
 		{
 			auto& splayer = splayers[player.id];
@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2017, 2018 Florian Jung
+ *
+ * This file is part of factorio-bot.
+ *
+ * factorio-bot is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License,
+ * version 3, as published by the Free Software Foundation.
+ *
+ * factorio-bot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with factorio-bot. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <chrono>
+#include <algorithm>
+
+#include "packet_pipeline.hpp"
+
+using namespace std;
+
+size_t PacketPipeline::default_n_workers()
+{
+	// leave one core for the main thread and one for the reader
+	size_t n_cores = thread::hardware_concurrency();
+	return max(size_t(1), n_cores > 2 ? n_cores-2 : 1);
+}
+
+PacketPipeline::PacketPipeline(FactorioGame* game_, size_t n_workers) : game(game_)
+{
+	reader = thread(&PacketPipeline::reader_main, this);
+	for (size_t i=0; i<n_workers; i++)
+		workers.emplace_back(&PacketPipeline::worker_main, this);
+}
+
+PacketPipeline::~PacketPipeline()
+{
+	{
+		lock_guard<std::mutex> lock(queue_mutex);
+		stopping = true;
+	}
+	work_available.notify_all();
+	space_available.notify_all();
+
+	reader.join();
+	for (auto& worker : workers)
+		worker.join();
+}
+
+void PacketPipeline::reader_main()
+{
+	while (true)
+	{
+		string_view packet = game->read_packet();
+		uint64_t file_offset = game->read_position();
+
+		unique_lock<std::mutex> lock(queue_mutex);
+		if (stopping)
+			return;
+
+		if (packet.empty())
+		{
+			// we have caught up with the mod, wait for it to write more
+			reader_idle = true;
+			job_done.notify_all();
+			lock.unlock();
+			this_thread::sleep_for(chrono::milliseconds(1));
+			continue;
+		}
+		reader_idle = false;
+
+		space_available.wait(lock, [this]{ return stopping || in_flight.size() < MAX_IN_FLIGHT; });
+		if (stopping)
+			return;
+
+		auto job = make_unique<job_t>();
+		job->raw = string(packet);
+		job->file_offset = file_offset;
+		todo.push_back(job.get());
+		in_flight.push_back(move(job));
+		work_available.notify_one();
+	}
+}
+
+void PacketPipeline::worker_main()
+{
+	while (true)
+	{
+		job_t* job;
+		{
+			unique_lock<std::mutex> lock(queue_mutex);
+			work_available.wait(lock, [this]{ return stopping || !todo.empty(); });
+			if (stopping)
+				return;
+
+			job = todo.front();
+			todo.pop_front();
+		}
+
+		// job->raw is not touched by anyone else until job->done is set
+		try
+		{
+			job->decoded = game->decode_packet(job->raw);
+			job->decoded.file_offset = job->file_offset;
+		}
+		catch (...)
+		{
+			job->error = current_exception();
+		}
+
+		{
+			lock_guard<std::mutex> lock(queue_mutex);
+			job->done = true;
+		}
+		job_done.notify_all();
+	}
+}
+
+bool PacketPipeline::commit(size_t max_packets, bool wait)
+{
+	for (size_t i=0; i<max_packets; i++)
+	{
+		unique_ptr<job_t> job;
+		{
+			unique_lock<std::mutex> lock(queue_mutex);
+			if (wait)
+				job_done.wait(lock, [this]{ return in_flight.empty() ? reader_idle : in_flight.front()->done; });
+
+			if (in_flight.empty() || !in_flight.front()->done)
+				return false;
+
+			job = move(in_flight.front());
+			in_flight.pop_front();
+		}
+		space_available.notify_one();
+
+		if (job->error)
+			rethrow_exception(job->error);
+
+		if (game->commit_packet(move(job->decoded)))
+			return true;
+	}
+	return false;
+}
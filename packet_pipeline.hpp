@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2017, 2018 Florian Jung
+ *
+ * This file is part of factorio-bot.
+ *
+ * factorio-bot is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License,
+ * version 3, as published by the Free Software Foundation.
+ *
+ * factorio-bot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with factorio-bot. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <string>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+
+#include "factorio_io.h"
+
+/** Reads and decodes packets from the mod's output file in the background.
+  *
+  * A reader thread splits the file into packets, a pool of worker threads decodes
+  * them (see FactorioGame::decode_packet()), and the owner of the pipeline commits
+  * the decoded packets to the game state in file order by calling commit(). This
+  * means that walk_map, resource_map, actual_entities etc. are still only ever
+  * written by a single thread.
+  *
+  * Once the pipeline has been constructed, nobody else may call game->read_packet(),
+  * and all prototype packets must have been parsed already.
+  */
+class PacketPipeline
+{
+	public:
+		/** max. number of packets that are read ahead, but not committed yet */
+		static constexpr size_t MAX_IN_FLIGHT = 4096;
+
+		PacketPipeline(FactorioGame* game, size_t n_workers = default_n_workers());
+		~PacketPipeline();
+		PacketPipeline(const PacketPipeline&) = delete;
+		PacketPipeline& operator=(const PacketPipeline&) = delete;
+
+		/** commits up to `max_packets` already decoded packets, in file order. Stops early
+		  * after a "tick" packet has been committed, and returns true in this case, i.e. if
+		  * the game state is consistent now (see FactorioGame::parse_packet()).
+		  * If `wait` is set, this waits for the next packet to be decoded, unless the reader
+		  * has caught up with the file. Exceptions thrown while decoding a packet are
+		  * rethrown here, when it would have been committed. */
+		bool commit(size_t max_packets = 1, bool wait = false);
+
+		static size_t default_n_workers();
+
+	private:
+		struct job_t
+		{
+			std::string raw;
+			uint64_t file_offset; // just past raw, see FactorioGame::read_position()
+			FactorioGame::decoded_packet_t decoded; // points into raw
+			std::exception_ptr error;
+			bool done = false;
+		};
+
+		void reader_main();
+		void worker_main();
+
+		FactorioGame* game;
+
+		std::mutex queue_mutex;
+		std::condition_variable work_available; // signalled when `todo` gets non-empty or when stopping
+		std::condition_variable job_done; // signalled when a job is done or when the reader is idle
+		std::condition_variable space_available; // signalled when `in_flight` shrinks
+		std::deque< std::unique_ptr<job_t> > in_flight; // in file order
+		std::deque<job_t*> todo; // jobs not yet picked up by a worker
+		bool reader_idle = false; // the reader has hit the end of the file
+		bool stopping = false;
+
+		std::thread reader;
+		std::vector<std::thread> workers;
+};
@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2017, 2018 Florian Jung
+ *
+ * This file is part of factorio-bot.
+ *
+ * factorio-bot is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License,
+ * version 3, as published by the Free Software Foundation.
+ *
+ * factorio-bot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with factorio-bot. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdexcept>
+#include <system_error>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "packet_reader.hpp"
+
+using namespace std;
+
+bool PacketReader::open(const string& filename, uint64_t offset)
+{
+	close();
+
+	fd = ::open(filename.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	if (offset > 0)
+	{
+		struct stat st;
+		if (fstat(fd, &st) != 0 || uint64_t(st.st_size) < offset || lseek(fd, offset, SEEK_SET) < 0)
+		{
+			close();
+			return false;
+		}
+	}
+
+	buffer.resize(BLOCK_SIZE);
+	begin = end = scanned = 0;
+	buffer_offset = offset;
+	return true;
+}
+
+void PacketReader::close()
+{
+	if (fd >= 0)
+		::close(fd);
+	fd = -1;
+	begin = end = scanned = 0;
+	buffer_offset = 0;
+}
+
+string PacketReader::read_at(uint64_t offset, size_t len) const
+{
+	if (!is_open())
+		throw logic_error("PacketReader::read_at() on a closed file");
+
+	string result(len, '\0');
+	size_t n_total = 0;
+	while (n_total < len)
+	{
+		ssize_t n_read = ::pread(fd, result.data() + n_total, len - n_total, offset + n_total);
+		if (n_read < 0 && errno == EINTR)
+			continue;
+		if (n_read < 0)
+			throw system_error(errno, generic_category(), "file reading error");
+		if (n_read == 0)
+			break;
+		n_total += n_read;
+	}
+	result.resize(n_total);
+	return result;
+}
+
+bool PacketReader::fill()
+{
+	// make space: drop the consumed part, and grow if a single packet fills the whole buffer
+	if (begin > 0)
+	{
+		memmove(buffer.data(), buffer.data() + begin, end - begin);
+		buffer_offset += begin;
+		scanned -= begin;
+		end -= begin;
+		begin = 0;
+	}
+	if (buffer.size() - end < BLOCK_SIZE / 2)
+		buffer.resize(buffer.size() + BLOCK_SIZE);
+
+	ssize_t n_read;
+	do
+		n_read = ::read(fd, buffer.data() + end, buffer.size() - end);
+	while (n_read < 0 && errno == EINTR);
+
+	if (n_read < 0)
+		throw system_error(errno, generic_category(), "file reading error");
+
+	end += n_read;
+	return n_read > 0;
+}
+
+string_view PacketReader::next_packet()
+{
+	if (!is_open())
+		return string_view();
+
+	while (true)
+	{
+		if (const char* newline = static_cast<const char*>(memchr(buffer.data() + scanned, '\n', end - scanned)))
+		{
+			size_t pos = newline - buffer.data();
+			string_view result(buffer.data() + begin, pos - begin);
+			begin = scanned = pos + 1;
+			return result;
+		}
+		scanned = end;
+
+		// no complete packet in the buffer. read more, unless we're at the end of the file
+		if (!fill())
+			return string_view();
+	}
+}
@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2017, 2018 Florian Jung
+ *
+ * This file is part of factorio-bot.
+ *
+ * factorio-bot is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License,
+ * version 3, as published by the Free Software Foundation.
+ *
+ * factorio-bot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with factorio-bot. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+/** Reads newline-separated packets from the file written by the mod.
+  *
+  * The file is still being appended to while we read it, so it is streamed in
+  * large blocks into an internal buffer. Packets are handed out as string_views
+  * pointing into that buffer, so that no packet is copied on its way to the
+  * parser. Bytes are only ever moved when an incomplete packet at the end of the
+  * buffer needs to be shifted to the front to make space for the next block.
+  */
+class PacketReader
+{
+	public:
+		static constexpr size_t BLOCK_SIZE = 1 << 20;
+
+		PacketReader() {}
+		~PacketReader() { close(); }
+		PacketReader(const PacketReader&) = delete;
+		PacketReader& operator=(const PacketReader&) = delete;
+
+		/** opens the file and starts reading at byte `offset`, which must be the start
+		  * of a packet. returns false if it could not be opened (yet), or if it is
+		  * shorter than `offset`. */
+		bool open(const std::string& filename, uint64_t offset = 0);
+		void close();
+		bool is_open() const { return fd >= 0; }
+
+		/** returns the next complete packet, without the trailing newline, or an
+		  * empty view if no complete packet is available yet. The returned view
+		  * remains valid until the next call to next_packet() or close(). */
+		std::string_view next_packet();
+
+		/** returns the file offset just past the packet last returned by next_packet(),
+		  * i.e. where reading would resume after reopening the file. */
+		uint64_t position() const { return buffer_offset + begin; }
+
+		/** returns up to `len` bytes of the file, starting at `offset`, without
+		  * affecting next_packet(). Fewer bytes are returned at the end of the file. */
+		std::string read_at(uint64_t offset, size_t len) const;
+
+	private:
+		/** reads the next block from the file. returns false if nothing could be read. */
+		bool fill();
+
+		int fd = -1;
+		std::vector<char> buffer;
+		uint64_t buffer_offset = 0; // file offset of buffer[0]
+		size_t begin = 0; // first unconsumed byte in buffer
+		size_t end = 0; // one past the last valid byte in buffer
+		size_t scanned = 0; // buffer[begin..scanned) is known to not contain a newline
+};
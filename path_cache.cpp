@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2017, 2018 Florian Jung
+ *
+ * This file is part of factorio-bot.
+ *
+ * factorio-bot is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License,
+ * version 3, as published by the Free Software Foundation.
+ *
+ * factorio-bot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with factorio-bot. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cmath>
+#include <boost/functional/hash.hpp>
+
+#include "path_cache.hpp"
+
+using namespace std;
+using namespace pathfinding;
+
+size_t PathCache::query_hash::operator()(const query_t& query) const
+{
+	size_t h = 0;
+	boost::hash_combine(h, hash<Pos>{}(query.start));
+	boost::hash_combine(h, query.end.left_top.x);
+	boost::hash_combine(h, query.end.left_top.y);
+	boost::hash_combine(h, query.end.right_bottom.x);
+	boost::hash_combine(h, query.end.right_bottom.y);
+	boost::hash_combine(h, query.allowed_distance);
+	boost::hash_combine(h, query.min_distance);
+	boost::hash_combine(h, query.size);
+	return h;
+}
+
+bool PathCache::outdated(const entry_t& entry) const
+{
+	if (entry.version == version) // nothing has changed at all
+		return false;
+
+	for (int x = entry.chunks.left_top.x; x < entry.chunks.right_bottom.x; x++)
+		for (int y = entry.chunks.left_top.y; y < entry.chunks.right_bottom.y; y++)
+		{
+			auto it = chunk_versions.find(Pos(x,y));
+			if (it != chunk_versions.end() && it->second > entry.version)
+				return true;
+		}
+	return false;
+}
+
+optional<PathCache::result_t> PathCache::find(const query_t& query, double length_limit, bool need_path)
+{
+	lock_guard<std::mutex> lock(mutex);
+
+	auto it = entries.find(query);
+	if (it != entries.end() && outdated(it->second))
+	{
+		entries.erase(it);
+		it = entries.end();
+		statistics.outdated++;
+	}
+
+	if (it != entries.end())
+	{
+		const entry_t& entry = it->second;
+		if (entry.result.length.has_value())
+		{
+			if (*entry.result.length > length_limit)
+			{
+				statistics.hits++;
+				return result_t{nullopt, {}};
+			}
+			if (!need_path || !entry.result.path.empty())
+			{
+				statistics.hits++;
+				return entry.result;
+			}
+		}
+		else if (length_limit <= entry.length_limit) // nothing was found with a larger limit
+		{
+			statistics.hits++;
+			return entry.result;
+		}
+	}
+
+	statistics.misses++;
+	return nullopt;
+}
+
+void PathCache::insert(const query_t& query, double length_limit, const result_t& result)
+{
+	// any path that is not longer than this stays within an ellipse whose foci are the start and
+	// some point of `end`, and whose semi-major axis is reach/2. Such an ellipse sticks out of the
+	// rectangle around start and end by at most its semi-minor axis, on every side, and that is
+	// largest for the point of `end` closest to the start.
+	double dist = distance(query.start, query.end);
+	double reach = result.length.value_or(length_limit) + query.allowed_distance;
+	if (!isfinite(reach)) // no path with an infinite length limit. We can't tell where that might change.
+		return;
+	double semi_minor = 0.5 * sqrt(max(0., reach*reach - dist*dist));
+
+	Area_f box = query.end.expand(Area_f(query.start, query.start)).expand(semi_minor + 3.); // plus the tiles around the vertices
+	Area chunks(
+		Pos::tile_to_chunk(Pos(int(floor(box.left_top.x)), int(floor(box.left_top.y)))),
+		Pos::tile_to_chunk_ceil(Pos(int(ceil(box.right_bottom.x)), int(ceil(box.right_bottom.y)))) );
+
+	lock_guard<std::mutex> lock(mutex);
+	if (entries.size() >= MAX_ENTRIES)
+		entries.clear();
+	entries[query] = entry_t{result, length_limit, chunks, version};
+}
+
+void PathCache::invalidate(const Area& area)
+{
+	// a step depends on the tiles next to its vertices
+	Pos lefttop = Pos::tile_to_chunk(area.left_top - Pos(1,1));
+	Pos rightbot = Pos::tile_to_chunk_ceil(area.right_bottom + Pos(2,2));
+
+	lock_guard<std::mutex> lock(mutex);
+	version++;
+	for (int x = lefttop.x; x < rightbot.x; x++)
+		for (int y = lefttop.y; y < rightbot.y; y++)
+			chunk_versions[Pos(x,y)] = version;
+}
+
+void PathCache::clear()
+{
+	lock_guard<std::mutex> lock(mutex);
+	entries.clear();
+}
+
+PathCache::stats_t PathCache::stats() const
+{
+	lock_guard<std::mutex> lock(mutex);
+	return statistics;
+}
@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2017, 2018 Florian Jung
+ *
+ * This file is part of factorio-bot.
+ *
+ * factorio-bot is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License,
+ * version 3, as published by the Free Software Foundation.
+ *
+ * factorio-bot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with factorio-bot. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <vector>
+#include <optional>
+#include <mutex>
+#include <unordered_map>
+#include <cstdint>
+
+#include "pos.hpp"
+#include "area.hpp"
+
+namespace pathfinding
+{
+	/** Remembers the results of path queries, until the walk map changes near them.
+	  *
+	  * Every chunk has a version, which invalidate() bumps. Each entry remembers the chunks in
+	  * which a change could affect it: its path can not leave the ellipse around start and goal
+	  * whose size is given by the path length (or the length_limit, if none was found), and
+	  * neither can any shorter one. An entry is outdated as soon as any of these chunks has
+	  * changed after it was stored.
+	  */
+	class PathCache
+	{
+		public:
+			struct query_t
+			{
+				Pos start;
+				Area_f end;
+				double allowed_distance;
+				double min_distance;
+				double size;
+
+				bool operator==(const query_t& other) const
+				{
+					return start == other.start && end == other.end && allowed_distance == other.allowed_distance &&
+						min_distance == other.min_distance && size == other.size;
+				}
+			};
+
+			struct result_t
+			{
+				std::optional<double> length; // nullopt if there is no path within the length limit
+				std::vector<Pos> path; // empty if only the length was asked for
+			};
+
+			struct stats_t
+			{
+				size_t hits = 0;
+				size_t misses = 0;
+				size_t outdated = 0; // misses because the entry was invalidated
+			};
+
+			/** the cache is cleared when it grows larger than this */
+			static constexpr size_t MAX_ENTRIES = 1 << 16;
+
+			/** returns the cached result of `query` with the given `length_limit`, if it is known
+			  * and still valid. If `need_path` is set, length-only results do not count. */
+			std::optional<result_t> find(const query_t& query, double length_limit, bool need_path);
+			void insert(const query_t& query, double length_limit, const result_t& result);
+
+			/** marks all results that depend on the tiles in `area` as outdated */
+			void invalidate(const Area& area);
+			void clear();
+
+			stats_t stats() const;
+
+		private:
+			struct query_hash
+			{
+				size_t operator()(const query_t& query) const;
+			};
+
+			struct entry_t
+			{
+				result_t result;
+				double length_limit;
+				Area chunks; // in chunk coordinates
+				uint64_t version;
+			};
+
+			mutable std::mutex mutex;
+			std::unordered_map<query_t, entry_t, query_hash> entries;
+			std::unordered_map<Pos, uint64_t> chunk_versions; // the version at which each chunk has changed last
+			uint64_t version = 0;
+			stats_t statistics;
+
+			bool outdated(const entry_t& entry) const;
+	};
+}
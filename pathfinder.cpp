@@ -0,0 +1,308 @@
+/*
+ * Copyright (c) 2017, 2018 Florian Jung
+ *
+ * This file is part of factorio-bot.
+ *
+ * factorio-bot is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License,
+ * version 3, as published by the Free Software Foundation.
+ *
+ * factorio-bot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with factorio-bot. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cmath>
+#include <climits>
+#include <unordered_map>
+#include <algorithm>
+#include <cassert>
+
+#include "pathfinder.hpp"
+#include "dary_heap.hpp"
+#include "logging.hpp"
+
+using namespace std;
+using namespace pathfinding;
+
+bool Pathfinder::unreachable(const Pos& start, const Area_f& end, double allowed_distance, double size) const
+{
+	return size >= Components::SIZE && !components.may_reach(map, start, end, allowed_distance);
+}
+
+bool Pathfinder::use_hierarchy(const Pos& start, const Area_f& end, double allowed_distance, double size) const
+{
+	// the goal must fit into a few chunks, and must not share any with the start
+	return size == PortalGraph::SIZE && allowed_distance <= 32. &&
+		distance(start, end) - allowed_distance >= HIERARCHICAL_MIN_DISTANCE;
+}
+
+bool Pathfinder::use_landmarks(const Pos& start, const Area_f& end, double allowed_distance, double size) const
+{
+	// a_star_jps() skips over open ground much faster, so this is only worth it if the direct
+	// line is far off. An infinite bound means that there is no path at all.
+	if (size != Landmarks::SIZE || !landmarks.get_area().contains(start))
+		return false;
+	double direct = max(0., distance(start, end) - allowed_distance);
+	return landmarks.heuristic(map, end, allowed_distance)(start) > DETOUR_FACTOR * direct;
+}
+
+optional<Pathfinder::abstract_path_t> Pathfinder::find_abstract_path(const Pos& start, const Area_f& end, double allowed_distance, double min_distance, double length_limit) const
+{
+	Logger log("pathfinding");
+
+	auto is_goal = [&](const Pos& pos) {
+		double dist = distance(pos, end);
+		return dist <= allowed_distance && dist >= min_distance;
+	};
+
+	// connect the start to the nodes of its chunk
+	Pos start_chunk = Pos::chunk_to_tile(Pos::tile_to_chunk(start));
+	LocalGraph start_graph(map, Area(start_chunk, start_chunk + Pos(32,32)), PortalGraph::SIZE);
+	vector<float> from_start = start_graph.distances({{start, 0.f}}, false);
+
+	// and the nodes of the chunks around the goal to the goal
+	Area goal_box = pathfinding::goal_box(end, allowed_distance);
+	vector< pair<Pos,float> > goals;
+	for (int x = goal_box.left_top.x; x < goal_box.right_bottom.x; x++)
+		for (int y = goal_box.left_top.y; y < goal_box.right_bottom.y; y++)
+			if (is_goal(Pos(x,y)))
+				goals.emplace_back(Pos(x,y), 0.f);
+	if (goals.empty())
+		return nullopt;
+	LocalGraph goal_graph(map, Area(
+		Pos::chunk_to_tile(Pos::tile_to_chunk(goal_box.left_top)),
+		Pos::chunk_to_tile(Pos::tile_to_chunk_ceil(goal_box.right_bottom)) ), PortalGraph::SIZE);
+	vector<float> to_goal = goal_graph.distances(goals, true);
+
+	// A* on the nodes, with the goal as an extra node
+	const Pos GOAL(INT_MIN, INT_MIN);
+	struct state_t
+	{
+		double g_val;
+		Pos predecessor;
+		bool closed = false;
+	};
+	unordered_map<Pos, state_t> states;
+	DaryHeap<Entry> openlist;
+
+	auto relax = [&](const Pos& pos, const Pos& predecessor, double g_val) {
+		double f = g_val + (pos == GOAL ? 0. : max(0., distance(pos, end) - allowed_distance));
+		if (f > length_limit)
+			return;
+		auto [it, inserted] = states.try_emplace(pos, state_t{g_val, predecessor});
+		if (!inserted)
+		{
+			if (it->second.closed || it->second.g_val <= g_val)
+				return;
+			it->second.g_val = g_val;
+			it->second.predecessor = predecessor;
+		}
+		openlist.push(Entry(pos, f));
+	};
+
+	states[start] = state_t{0., start, true};
+	for (const PortalGraph::node_t& node : portals.cluster(map, Pos::tile_to_chunk(start)).nodes)
+	{
+		float dist = from_start[start_graph.index(node.pos)];
+		if (dist < numeric_limits<float>::infinity())
+			relax(node.pos, start, dist);
+	}
+
+	int n_iterations = 0;
+	while (!openlist.empty())
+	{
+		Entry current = openlist.top();
+		openlist.pop();
+		state_t& state = states.at(current.pos);
+		if (state.closed)
+			continue; // outdated entry
+		state.closed = true;
+		n_iterations++;
+
+		if (current.pos == GOAL)
+		{
+			abstract_path_t result;
+			result.length = state.g_val;
+			for (Pos p = state.predecessor; p != start; p = states.at(p).predecessor)
+			{
+				result.nodes.push_back(p);
+				result.g_vals.push_back(states.at(p).g_val);
+			}
+			result.nodes.push_back(start);
+			result.g_vals.push_back(0.);
+			reverse(result.nodes.begin(), result.nodes.end());
+			reverse(result.g_vals.begin(), result.g_vals.end());
+
+			log << "abstract path from " << start.str() << " to " << end.str() << " has " << result.nodes.size() << " nodes and a length of " << result.length << " (" << n_iterations << " iterations)" << endl;
+			return result;
+		}
+
+		if (goal_graph.area.contains(current.pos))
+		{
+			float dist = to_goal[goal_graph.index(current.pos)];
+			if (dist < numeric_limits<float>::infinity())
+				relax(GOAL, current.pos, state.g_val + dist);
+		}
+
+		const PortalGraph::node_t* node = portals.cluster(map, Pos::tile_to_chunk(current.pos)).find(current.pos);
+		assert(node != nullptr);
+		for (const PortalGraph::edge_t& edge : node->edges)
+			relax(edge.to, current.pos, state.g_val + edge.cost);
+	}
+
+	log << "no abstract path from " << start.str() << " to " << end.str() << " (" << n_iterations << " iterations)" << endl;
+	return nullopt;
+}
+
+static double length_of(const vector<Pos>& path)
+{
+	double length = 0.;
+	for (size_t i = 1; i < path.size(); i++)
+		length += (path[i]-path[i-1]).len();
+	return length;
+}
+
+vector<Pos> Pathfinder::find_path(const Pos& start, const Area_f& end, double allowed_distance, double min_distance, double length_limit, double size) const
+{
+	PathCache::query_t query{start, end, allowed_distance, min_distance, size};
+	if (optional<PathCache::result_t> cached = cache.find(query, length_limit, true))
+		return cached->path;
+
+	if (unreachable(start, end, allowed_distance, size))
+	{
+		Logger log("pathfinding");
+		log << "no path from " << start.str() << " to " << end.str() << ", the goal is in another region" << endl;
+		return {};
+	}
+
+	vector<Pos> path = find_path_uncached(start, end, allowed_distance, min_distance, length_limit, size);
+	cache.insert(query, length_limit, PathCache::result_t{
+		path.empty() ? nullopt : optional<double>(length_of(path)),
+		path });
+	return path;
+}
+
+optional<double> Pathfinder::path_length(const Pos& start, const Area_f& end, double allowed_distance, double min_distance, double length_limit, double size) const
+{
+	PathCache::query_t query{start, end, allowed_distance, min_distance, size};
+	if (optional<PathCache::result_t> cached = cache.find(query, length_limit, false))
+		return cached->length;
+
+	if (unreachable(start, end, allowed_distance, size))
+		return nullopt;
+
+	optional<double> length = path_length_uncached(start, end, allowed_distance, min_distance, length_limit, size);
+	cache.insert(query, length_limit, PathCache::result_t{length, {}});
+	return length;
+}
+
+vector< optional<double> > Pathfinder::path_lengths(const Pos& start, const vector<Area_f>& ends, double allowed_distance, double min_distance, double length_limit, double size) const
+{
+	vector< optional<double> > result(ends.size());
+	vector<Area_f> missing_ends;
+	vector<size_t> missing_indices;
+	for (size_t i = 0; i < ends.size(); i++)
+	{
+		PathCache::query_t query{start, ends[i], allowed_distance, min_distance, size};
+		if (optional<PathCache::result_t> cached = cache.find(query, length_limit, false))
+			result[i] = cached->length;
+		else if (!unreachable(start, ends[i], allowed_distance, size))
+		{
+			missing_ends.push_back(ends[i]);
+			missing_indices.push_back(i);
+		}
+	}
+
+	if (missing_ends.empty())
+		return result;
+
+	vector< optional<double> > lengths = multi_target_distances(start, missing_ends, map, allowed_distance, min_distance, length_limit, size);
+	for (size_t j = 0; j < missing_ends.size(); j++)
+	{
+		cache.insert(PathCache::query_t{start, missing_ends[j], allowed_distance, min_distance, size}, length_limit, PathCache::result_t{lengths[j], {}});
+		result[missing_indices[j]] = lengths[j];
+	}
+	return result;
+}
+
+BudgetedSearch Pathfinder::start_search(const Pos& start, const Area_f& end, double allowed_distance, double min_distance, double length_limit, double size) const
+{
+	PathCache::query_t query{start, end, allowed_distance, min_distance, size};
+	if (cache.find(query, length_limit, true) || use_hierarchy(start, end, allowed_distance, size) ||
+		distance(start, end) - allowed_distance < BUDGETED_MIN_DISTANCE)
+		return BudgetedSearch::finished(map, find_path(start, end, allowed_distance, min_distance, length_limit, size), size);
+
+	return BudgetedSearch(map, start, end, allowed_distance, min_distance, length_limit, size, &components);
+}
+
+vector<Pos> Pathfinder::find_path_uncached(const Pos& start, const Area_f& end, double allowed_distance, double min_distance, double length_limit, double size) const
+{
+	if (!use_hierarchy(start, end, allowed_distance, size))
+	{
+		if (use_landmarks(start, end, allowed_distance, size))
+			return a_star_alt(start, end, map, landmarks, allowed_distance, min_distance, length_limit, size);
+		return a_star_jps(start, end, map, jumps, allowed_distance, min_distance, length_limit, size);
+	}
+
+	optional<abstract_path_t> abstract = find_abstract_path(start, end, allowed_distance, min_distance, length_limit);
+	if (!abstract)
+		return {};
+
+	// refine each abstract edge. Steps across a chunk border are taken directly, all others
+	// lead to a vertex within the same chunk, so their search stays small.
+	vector<Pos> result{start};
+	const vector<Pos>& nodes = abstract->nodes;
+	for (size_t i = 1; i <= nodes.size(); i++)
+	{
+		const Pos& from = nodes[i-1];
+		vector<Pos> segment;
+		if (i == nodes.size())
+			segment = a_star_jps_raw(from, end, map, jumps, allowed_distance, min_distance, abstract->length - abstract->g_vals[i-1] + 2., size);
+		else if (Pos::tile_to_chunk(from) != Pos::tile_to_chunk(nodes[i]))
+			segment = {from, nodes[i]};
+		else
+			segment = a_star_jps_raw(from, Area_f(nodes[i], nodes[i]), map, jumps, 0.5, 0., abstract->g_vals[i] - abstract->g_vals[i-1] + 2., size);
+
+		if (segment.empty()) // should not happen, unless the abstract graph is out of date
+		{
+			Logger log("pathfinding");
+			log << "refining the abstract path from " << from.str() << " failed, falling back to a_star_jps" << endl;
+			return a_star_jps(start, end, map, jumps, allowed_distance, min_distance, length_limit, size);
+		}
+		result.insert(result.end(), segment.begin()+1, segment.end());
+	}
+
+	return smooth_path(result, map, size);
+}
+
+optional<double> Pathfinder::path_length_uncached(const Pos& start, const Area_f& end, double allowed_distance, double min_distance, double length_limit, double size) const
+{
+	if (!use_hierarchy(start, end, allowed_distance, size))
+	{
+		vector<Pos> path = use_landmarks(start, end, allowed_distance, size)
+			? a_star_alt_raw(start, end, map, landmarks, allowed_distance, min_distance, length_limit, size)
+			: a_star_jps_raw(start, end, map, jumps, allowed_distance, min_distance, length_limit, size);
+		if (path.empty())
+			return nullopt;
+		return length_of(path);
+	}
+
+	optional<abstract_path_t> abstract = find_abstract_path(start, end, allowed_distance, min_distance, length_limit);
+	if (!abstract)
+		return nullopt;
+	return abstract->length;
+}
+
+double Pathfinder::travel_distance(const Pos& start, const Area_f& end, double allowed_distance) const
+{
+	PathCache::query_t query{start, end, allowed_distance, 0., PortalGraph::SIZE};
+	if (optional<PathCache::result_t> cached = cache.find(query, numeric_limits<double>::infinity(), false))
+		return cached->length.value_or(numeric_limits<double>::infinity());
+
+	return oracle.distance(map, portals, start, end, allowed_distance);
+}
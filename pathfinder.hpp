@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2017, 2018 Florian Jung
+ *
+ * This file is part of factorio-bot.
+ *
+ * factorio-bot is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License,
+ * version 3, as published by the Free Software Foundation.
+ *
+ * factorio-bot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with factorio-bot. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <optional>
+#include <limits>
+
+#include "pathfinding.hpp"
+#include "jump_table.hpp"
+#include "landmarks.hpp"
+#include "portal_graph.hpp"
+#include "path_cache.hpp"
+#include "hub_fields.hpp"
+#include "travel_oracle.hpp"
+#include "components.hpp"
+#include "budgeted_search.hpp"
+#include "worldmap.hpp"
+#include "pos.hpp"
+#include "area.hpp"
+
+namespace pathfinding
+{
+	/** Answers path queries on a walk map. Short queries are passed to a_star_jps(), or to
+	  * a_star_alt() if the Landmarks show that the path has to go around something big, like a
+	  * lake. Long ones are first solved on the PortalGraph, which only needs to look at a few
+	  * nodes per chunk, and then refined into a tile path one abstract edge at a time.
+	  *
+	  * Owns the precomputed data for both, which must be invalidate()d whenever tiles of the
+	  * walk map change. Results are kept in a PathCache, so repeated queries are cheap until the
+	  * map changes near them. Like a_star(), this only reads the map, and queries may run concurrently.
+	  */
+	class Pathfinder
+	{
+		public:
+			/** queries whose start is at least this far away from the goal use the PortalGraph */
+			static constexpr double HIERARCHICAL_MIN_DISTANCE = 4*32;
+			/** start_search() answers queries whose start is closer than this to the goal right
+			  * away with a_star_jps(), because that only takes a moment for them */
+			static constexpr double BUDGETED_MIN_DISTANCE = 32;
+			/** short queries use a_star_alt() if the Landmarks bound the length of their path by
+			  * more than this times the direct line */
+			static constexpr double DETOUR_FACTOR = 1.2;
+
+			Pathfinder(const WorldMap<walk_t>& map_) : map(map_) {}
+
+			/** marks everything that depends on the tiles in `area` as outdated */
+			void invalidate(const Area& area) { jumps.invalidate(area); landmarks.invalidate(area); portals.invalidate(area); cache.invalidate(area); hubs.invalidate(area); oracle.invalidate(area); components.invalidate(area); }
+			/** forgets everything, e.g. because the whole walk map was replaced. Registered hubs are kept. */
+			void clear() { jumps.clear(); landmarks.clear(); portals.clear(); cache.clear(); hubs.clear(); oracle.clear(); components.clear(); }
+
+			/** like a_star(). For long queries, the path is not always the shortest one, because it
+			  * may only cross chunk borders at portals. Likewise, a path that is only slightly shorter
+			  * than length_limit may not be found. */
+			std::vector<Pos> find_path(const Pos& start, const Area_f& end, double allowed_distance=1., double min_distance=0., double length_limit=std::numeric_limits<double>::infinity(), double size=0.5) const;
+
+			/** returns the length of the path that find_path() would return (approximately, for long
+			  * queries), or nullopt if there is none. This does not need to refine long queries. */
+			std::optional<double> path_length(const Pos& start, const Area_f& end, double allowed_distance=1., double min_distance=0., double length_limit=std::numeric_limits<double>::infinity(), double size=0.5) const;
+
+			/** like path_length() for each of `ends`, but uses a single multi_target_distances() search
+			  * for all that are not cached yet. */
+			std::vector< std::optional<double> > path_lengths(const Pos& start, const std::vector<Area_f>& ends, double allowed_distance=1., double min_distance=0., double length_limit=std::numeric_limits<double>::infinity(), double size=0.5) const;
+
+			/** like find_path(), but returns a search that can be run a bit at a time. Queries that
+			  * are cached, that are short or that use the PortalGraph are answered right away, because
+			  * they are fast. Only the ones in between are searched by plain A* in the BudgetedSearch. */
+			BudgetedSearch start_search(const Pos& start, const Area_f& end, double allowed_distance=1., double min_distance=0., double length_limit=std::numeric_limits<double>::infinity(), double size=0.5) const;
+
+			/** returns false if there is certainly no path between `a` and `b`, see Components */
+			bool same_region(const Pos& a, const Pos& b) const { return components.same_region(map, a, b); }
+			/** returns false if there is certainly no path from `start` to within `allowed_distance` of `end` */
+			bool may_reach(const Pos& start, const Area_f& end, double allowed_distance=1.) const { return components.may_reach(map, start, end, allowed_distance); }
+
+			/** quickly estimates the length of the shortest path from `start` to any position within
+			  * `allowed_distance` of `end`, for planning. Exact lengths from earlier queries are
+			  * reused, anything else is answered by the TravelOracle. Returns infinity if there is
+			  * no path. */
+			double travel_distance(const Pos& start, const Area_f& end, double allowed_distance=1.) const;
+
+			/** registers a place that is visited often, see HubFields */
+			void add_hub(const std::string& name, const Pos& pos, int radius = HubFields::RADIUS) { hubs.add_hub(name, pos, radius); }
+			void remove_hub(const std::string& name) { hubs.remove_hub(name); }
+
+			std::optional<double> distance_to_hub(const std::string& name, const Pos& pos) const { return hubs.distance_to(map, name, pos); }
+			std::optional<double> distance_from_hub(const std::string& name, const Pos& pos) const { return hubs.distance_from(map, name, pos); }
+			std::vector<Pos> path_to_hub(const std::string& name, const Pos& pos) const { return hubs.path_to(map, name, pos); }
+			std::vector<Pos> path_from_hub(const std::string& name, const Pos& pos) const { return hubs.path_from(map, name, pos); }
+
+			/** a lower bound for the walking distance from `start` to `end` if some hub is near both,
+			  * see HubFields::distance_estimate() */
+			std::optional<double> distance_estimate(const Pos& start, const Pos& end) const { return hubs.distance_estimate(map, start, end); }
+
+			const JumpTable& jump_table() const { return jumps; }
+			const Landmarks& landmark_table() const { return landmarks; }
+			/** places the landmarks within `area`, e.g. around the base. Until then, none are used. */
+			void set_landmark_area(const Area& area) { landmarks.set_area(area); }
+			const PortalGraph& portal_graph() const { return portals; }
+			PathCache::stats_t cache_stats() const { return cache.stats(); }
+			Components::stats_t component_stats() const { return components.stats(); }
+
+		private:
+			struct abstract_path_t
+			{
+				std::vector<Pos> nodes; // starting with the start, ending next to the goal
+				std::vector<double> g_vals; // the distance from start to each node
+				double length;
+			};
+
+			bool unreachable(const Pos& start, const Area_f& end, double allowed_distance, double size) const;
+			bool use_hierarchy(const Pos& start, const Area_f& end, double allowed_distance, double size) const;
+			bool use_landmarks(const Pos& start, const Area_f& end, double allowed_distance, double size) const;
+			std::optional<abstract_path_t> find_abstract_path(const Pos& start, const Area_f& end, double allowed_distance, double min_distance, double length_limit) const;
+			std::vector<Pos> find_path_uncached(const Pos& start, const Area_f& end, double allowed_distance, double min_distance, double length_limit, double size) const;
+			std::optional<double> path_length_uncached(const Pos& start, const Area_f& end, double allowed_distance, double min_distance, double length_limit, double size) const;
+
+			const WorldMap<walk_t>& map;
+			JumpTable jumps;
+			Landmarks landmarks;
+			PortalGraph portals;
+			mutable PathCache cache;
+			HubFields hubs;
+			mutable TravelOracle oracle;
+			Components components;
+	};
+}
@@ -24,14 +24,19 @@
 #include <cmath>
 #include <algorithm>
 #include <unordered_set>
+#include <unordered_map>
 #ifdef DEBUG_PATHFINDING
 #include "logging.hpp"
 #endif
 
 #include <boost/heap/binomial_heap.hpp>
 #include <cassert>
+#include <optional>
 
 #include "pathfinding.hpp"
+#include "jump_table.hpp"
+#include "landmarks.hpp"
+#include "dary_heap.hpp"
 #include "worldmap.hpp"
 #include "factorio_io.h"
 #include "pos.hpp"
@@ -40,6 +45,80 @@
 using namespace std;
 using namespace pathfinding;
 
+#ifdef PATHFINDING_BINOMIAL_OPENLIST
+class OpenList
+{
+	public:
+		size_t size() const { return heap.size(); }
+		void clear() { heap.clear(); }
+
+		/** inserts `pos` with priority `f`, or lowers its priority if it is already in the list */
+		void push(search_t& state, const Pos& pos, double f)
+		{
+			if (state.opened)
+				heap.update(state.openlist_handle, Entry(pos, f));
+			else
+				state.openlist_handle = heap.push(Entry(pos, f));
+			state.opened = true;
+		}
+
+		/** removes and returns the entry with the lowest f, or nullopt if the list is empty */
+		optional<Entry> pop(SearchContext&)
+		{
+			if (heap.empty())
+				return nullopt;
+			Entry result = heap.top();
+			heap.pop();
+			return result;
+		}
+
+	private:
+		boost::heap::binomial_heap<Entry> heap;
+};
+#else
+class OpenList
+{
+	public:
+		size_t size() const { return heap.size(); }
+		void clear() { heap.clear(); }
+
+		/** inserts `pos` with priority `f`. If it is already in the list, the old entry is left
+		  * in place, and skipped by pop() later on. */
+		void push(search_t& state, const Pos& pos, double f)
+		{
+			heap.push(Entry(pos, f));
+			state.opened = true;
+		}
+
+		/** removes and returns the entry with the lowest f, or nullopt if the list is empty */
+		optional<Entry> pop(SearchContext& search)
+		{
+			while (!heap.empty())
+			{
+				Entry result = heap.top();
+				heap.pop();
+				// a tile is closed when its best entry is popped, so any other entry for it is outdated
+				if (!search.at(result.pos).in_closedlist)
+					return result;
+			}
+			return nullopt;
+		}
+
+	private:
+		DaryHeap<Entry, 4> heap;
+};
+#endif
+
+static thread_local SearchContext search_context;
+static thread_local OpenList search_openlist;
+// for the backward half of a_star_bidirectional()
+static thread_local SearchContext search_context_reverse;
+static thread_local OpenList search_openlist_reverse;
+
+static const Pos STEPS[] = {Pos(-1,-1), Pos(0, -1), Pos(1,-1),
+                            Pos(-1, 0),             Pos(1, 0),
+                            Pos(-1, 1), Pos(0,  1), Pos(1, 1)};
+
 
 /** controls the exactness-speed-tradeoff.
  * if set to 1.0, this equals the textbook A*-algorithm, which
@@ -77,12 +156,39 @@ vector<Pos> cleanup_path(const vector<Pos>& path)
 	return result;
 }
 
-vector<Pos> a_star(const Pos& start, const Area_f& end, WorldMap<walk_t>& map, double allowed_distance, double min_distance, double length_limit, double size)
+/** smooth_path() does not try to skip waypoints farther away than this, so that it stays cheap */
+constexpr int MAX_SMOOTHING_DISTANCE = 64;
+
+vector<Pos> smooth_path(const vector<Pos>& path, const WorldMap<walk_t>& map, double size)
 {
-	return cleanup_path(a_star_raw(start, end, map, allowed_distance, min_distance, length_limit, size));
+	vector<Pos> waypoints = cleanup_path(path);
+	if (waypoints.size() <= 2)
+		return waypoints;
+
+	auto view = map.dumb_view(Pos(0,0));
+	vector<Pos> result{waypoints[0]};
+	size_t anchor = 0;
+	for (size_t i = 2; i < waypoints.size(); i++)
+	{
+		// the original path from anchor to i-1 is fine, so only check whether i can be reached directly
+		Pos delta = waypoints[i] - waypoints[anchor];
+		if (max(abs(delta.x), abs(delta.y)) > MAX_SMOOTHING_DISTANCE || !can_walk_octile(view, waypoints[anchor], waypoints[i], size))
+		{
+			anchor = i-1;
+			result.push_back(waypoints[anchor]);
+		}
+	}
+	result.push_back(waypoints.back());
+
+	return result;
 }
 
-vector<Pos> a_star_raw(const Pos& start, const Area_f& end, WorldMap<walk_t>& map, double allowed_distance, double min_distance, double length_limit, double size)
+vector<Pos> a_star(const Pos& start, const Area_f& end, const WorldMap<walk_t>& map, double allowed_distance, double min_distance, double length_limit, double size)
+{
+	return smooth_path(a_star_raw(start, end, map, allowed_distance, min_distance, length_limit, size), map, size);
+}
+
+vector<Pos> a_star_raw(const Pos& start, const Area_f& end, const WorldMap<walk_t>& map, double allowed_distance, double min_distance, double length_limit, double size)
 {
 	#ifdef DEBUG_PATHFINDING
 	Logger log("pathfinding");
@@ -98,24 +204,28 @@ vector<Pos> a_star_raw(const Pos& start, const Area_f& end, WorldMap<walk_t>& ma
 	view_area.normalize();
 	auto view = map.view(view_area.left_top, view_area.right_bottom, Pos(0,0));
 
+	SearchContext& search = search_context;
+	search.reset();
+
 	assert(size<=1.);
 	vector<Pos> result;
 
-	boost::heap::binomial_heap<Entry> openlist;
-
-	vector<walk_t*> needs_cleanup;
+	OpenList& openlist = search_openlist;
+	openlist.clear();
 
-	view.at(start).openlist_handle = openlist.push(Entry(start,0.));
-	needs_cleanup.push_back(&view.at(start));
+	search.at(start).g_val = 0.;
+	openlist.push(search.at(start), start, 0.);
 
 	Logger verboselog("verbose");
 	int n_iterations = 0;
-	while (!openlist.empty())
+	while (true)
 	{
 		verboselog << "in iteration #" << n_iterations << ": openlist has size " << openlist.size() << flush;
-		auto current = openlist.top();
+		optional<Entry> top = openlist.pop(search);
+		if (!top)
+			break;
+		Entry current = *top;
 		verboselog << ", top is " << current.pos.str() << ", f=" << current.f << endl;
-		openlist.pop();
 		n_iterations++;
 
 		if (current.f >= length_limit*OVERAPPROXIMATE) // this (and any subsequent) entry is guaranteed
@@ -131,7 +241,7 @@ vector<Pos> a_star_raw(const Pos& start, const Area_f& end, WorldMap<walk_t>& ma
 			
 			while (p != start)
 			{
-				p = view.at(p).predecessor;
+				p = search.at(p).predecessor;
 				result.push_back(p);
 			}
 
@@ -142,10 +252,10 @@ vector<Pos> a_star_raw(const Pos& start, const Area_f& end, WorldMap<walk_t>& ma
 			log<<endl;
 			#endif
 
-			goto a_star_cleanup;
+			break;
 		}
 
-		view.at(current.pos).in_closedlist = true;
+		search.at(current.pos).in_closedlist = true;
 
 		// expand node
 		
@@ -156,42 +266,21 @@ vector<Pos> a_star_raw(const Pos& start, const Area_f& end, WorldMap<walk_t>& ma
 		for (const Pos& step : steps)
 		{
 			Pos successor = current.pos + step;
-			bool can_walk = false;
 
-			if (step.x == 0) // walking in vertical direction
-			{
-				auto x = current.pos.x;
-				auto y = min(current.pos.y, successor.y);
-				can_walk = view.at(x-1, y).margins[EAST] >= size/2 && view.at(x, y).margins[WEST] >= size/2 && view.at(x-1,y).can_walk && view.at(x,y).can_walk;
-			}
-			else if (step.y == 0) // walking in horizontal direction
-			{
-				auto x = min(current.pos.x, successor.x);
-				auto y = current.pos.y;
-				can_walk = view.at(x, y-1).margins[SOUTH] >= size/2 && view.at(x, y).margins[NORTH] >= size/2 && view.at(x,y-1).can_walk && view.at(x,y).can_walk;
-			}
-			else // walking diagonally
-			{
-				auto x = min(current.pos.x, successor.x);
-				auto y = min(current.pos.y, successor.y);
-				const auto& v = view.at(x,y);
-				can_walk = (v.margins[0]>=0.5 && v.margins[1]>=0.5 && v.margins[2]>=0.5 && v.margins[3]>=0.5) && v.can_walk && (view.at(x+step.x, y).can_walk || view.at(x, y+step.y).can_walk);
-			}
-
-			if (can_walk)
+			if (can_step(view, current.pos, step, size))
 			{
 				verboselog << "; " << successor.str() << flush;
 
-				auto& succ = view.at(successor);
+				auto& succ = search.at(successor);
 				if (succ.in_closedlist)
 					continue;
 				
 				verboselog << "*" << flush;
 
 				double cost = sqrt(step.x*step.x + step.y*step.y);
-				double new_g = view.at(current.pos).g_val + cost;
+				double new_g = search.at(current.pos).g_val + cost;
 
-				if (succ.openlist_handle != openlist_handle_t() && succ.g_val < new_g) // ignore this successor, when a better way is already known
+				if (succ.opened && succ.g_val < new_g) // ignore this successor, when a better way is already known
 					continue;
 
 				verboselog << "!" << flush;
@@ -202,31 +291,592 @@ vector<Pos> a_star_raw(const Pos& start, const Area_f& end, WorldMap<walk_t>& ma
 
 				verboselog << "f="<<f<<",g="<<new_g<<flush;
 				
-				if (succ.openlist_handle != openlist_handle_t())
+				if (!succ.opened)
+					verboselog << "(new)" << flush;
+				openlist.push(succ, successor, f);
+			}
+		}
+		verboselog << endl;
+	}
+
+	#ifdef DEBUG_PATHFINDING
+	log << "took " << n_iterations << " iterations or " << (n_iterations / max(1.0, (start-end.center()).len())) << " it/dist" << endl;
+	#endif
+
+	return result;
+}
+
+
+vector<Pos> a_star_alt(const Pos& start, const Area_f& end, const WorldMap<walk_t>& map, const Landmarks& landmarks, double allowed_distance, double min_distance, double length_limit, double size)
+{
+	return smooth_path(a_star_alt_raw(start, end, map, landmarks, allowed_distance, min_distance, length_limit, size), map, size);
+}
+
+vector<Pos> a_star_alt_raw(const Pos& start, const Area_f& end, const WorldMap<walk_t>& map, const Landmarks& landmarks, double allowed_distance, double min_distance, double length_limit, double size)
+{
+	#ifdef DEBUG_PATHFINDING
+	Logger log("pathfinding");
+	#endif
+
+	log << "a_star_alt from " << start.str() << " to " << end.str() << " (allowed_distance=" << allowed_distance << ", min_distance=" << min_distance << ", length_limit="<<length_limit<<", size="<<size<<endl;
+
+	if (ceil(min_distance) >= allowed_distance)
+		throw invalid_argument("ceil(min_distance) must be smaller than allowed distance");
+
+	// the tables only hold for one character size. For any other, only the direct line is a lower bound.
+	optional<Landmarks::Heuristic> alt;
+	if (size == Landmarks::SIZE)
+		alt.emplace(landmarks.heuristic(map, end, allowed_distance));
+	auto heuristic = [&](const Pos& pos) {
+		return alt ? (*alt)(pos) : max(0., distance(pos, end) - allowed_distance);
+	};
+
+	Area view_area = end;
+	view_area = view_area.expand(start);
+	view_area.normalize();
+	auto view = map.view(view_area.left_top, view_area.right_bottom, Pos(0,0));
+
+	SearchContext& search = search_context;
+	search.reset();
+
+	assert(size<=1.);
+	vector<Pos> result;
+
+	OpenList& openlist = search_openlist;
+	openlist.clear();
+
+	if (isinf(heuristic(start)))
+	{
+		log << "the goal can not be reached from the start" << endl;
+		return result;
+	}
+	search.at(start).g_val = 0.;
+	openlist.push(search.at(start), start, heuristic(start));
+
+	int n_iterations = 0;
+	while (optional<Entry> top = openlist.pop(search))
+	{
+		Entry current = *top;
+		n_iterations++;
+
+		// the heuristic is a lower bound, so this (and any subsequent) entry exceeds the length_limit.
+		if (current.f > length_limit)
+			break;
+
+		double dist = distance(current.pos, end);
+		if (dist <= allowed_distance && dist >= min_distance)
+		{
+			for (Pos p = current.pos; p != start; p = search.at(p).predecessor)
+				result.push_back(p);
+			result.push_back(start);
+			reverse(result.begin(), result.end());
+			break;
+		}
+
+		search_t& state = search.at(current.pos);
+		state.in_closedlist = true;
+		double g_val = state.g_val;
+
+		for (const Pos& step : STEPS)
+		{
+			if (!can_step(view, current.pos, step, size))
+				continue;
+
+			Pos successor = current.pos + step;
+			search_t& succ = search.at(successor);
+			if (succ.in_closedlist)
+				continue;
+
+			double new_g = g_val + step.len();
+			if (succ.opened && succ.g_val <= new_g)
+				continue;
+
+			double h = heuristic(successor);
+			if (isinf(h))
+				continue; // the goal can not be reached from there
+
+			succ.predecessor = current.pos;
+			succ.g_val = new_g;
+			openlist.push(succ, successor, new_g + h);
+		}
+	}
+
+	#ifdef DEBUG_PATHFINDING
+	log << "took " << n_iterations << " iterations or " << (n_iterations / max(1.0, (start-end.center()).len())) << " it/dist" << endl;
+	#endif
+
+	return result;
+}
+
+/** the farthest a_star_jps() jumps in one go. Unexplored areas are clear everywhere, and
+  * this keeps the scans through them finite. */
+constexpr int MAX_JUMP = 256;
+
+static Pos sign(const Pos& p)
+{
+	return Pos((p.x > 0) - (p.x < 0), (p.y > 0) - (p.y < 0));
+}
+
+static dir4_t dir4_of(const Pos& step)
+{
+	if (step.x > 0) return EAST;
+	if (step.x < 0) return WEST;
+	if (step.y > 0) return SOUTH;
+	return NORTH;
+}
+
+vector<Pos> a_star_jps(const Pos& start, const Area_f& end, const WorldMap<walk_t>& map, const JumpTable& jumps, double allowed_distance, double min_distance, double length_limit, double size)
+{
+	return smooth_path(a_star_jps_raw(start, end, map, jumps, allowed_distance, min_distance, length_limit, size), map, size);
+}
+
+vector<Pos> a_star_jps_raw(const Pos& start, const Area_f& end, const WorldMap<walk_t>& map, const JumpTable& jumps, double allowed_distance, double min_distance, double length_limit, double size)
+{
+	#ifdef DEBUG_PATHFINDING
+	Logger log("pathfinding");
+	#endif
+
+	log << "a_star_jps from " << start.str() << " to " << end.str() << " (allowed_distance=" << allowed_distance << ", min_distance=" << min_distance << ", length_limit="<<length_limit<<", size="<<size<<endl;
+
+	if (ceil(min_distance) >= allowed_distance)
+		throw invalid_argument("ceil(min_distance) must be smaller than allowed distance");
+
+	Area view_area = end;
+	view_area = view_area.expand(start);
+	view_area.normalize();
+	auto view = map.view(view_area.left_top, view_area.right_bottom, Pos(0,0));
+	JumpTable::View table = jumps.view(map);
+
+	SearchContext& search = search_context;
+	search.reset();
+
+	assert(size<=1.);
+	vector<Pos> result;
+
+	auto is_goal = [&](const Pos& pos) {
+		double dist = distance(pos, end);
+		return dist <= allowed_distance && dist >= min_distance;
+	};
+
+	// no vertex outside of this can be a goal, so the jumps only need to check each vertex inside it.
+	Area goal_box = pathfinding::goal_box(end, allowed_distance);
+
+	// returns how many straight steps can be taken from pos before entering the goal_box
+	auto steps_until_goal_box = [&](const Pos& pos, const Pos& step) {
+		if (goal_box.contains(pos))
+			return 0;
+		int result = numeric_limits<int>::max();
+		if (step.x != 0 && goal_box.contains_y(pos.y))
+		{
+			int gap = step.x > 0 ? goal_box.left_top.x - pos.x : pos.x - (goal_box.right_bottom.x-1);
+			if (gap > 0) result = gap;
+		}
+		if (step.y != 0 && goal_box.contains_x(pos.x))
+		{
+			int gap = step.y > 0 ? goal_box.left_top.y - pos.y : pos.y - (goal_box.right_bottom.y-1);
+			if (gap > 0) result = gap;
+		}
+		return result;
+	};
+
+	// whether `step` leads to a forced neighbor of the clear vertex `pos`, when coming from direction `dir`:
+	// one that can not be reached on a path of clear vertices that bypasses `pos`.
+	auto is_forced = [&](const Pos& pos, const Pos& dir, const Pos& step) {
+		if (step == dir)
+			return false;
+		if (dir.x == 0 || dir.y == 0) // straight: a diagonal step ahead, past a non-clear vertex
+			return step - dir == Pos(step.x*abs(dir.y), step.y*abs(dir.x)) && !table.clear(pos + step - dir) && table.clear(pos + step);
+		else // diagonal: a diagonal step that turns by 90 degrees, past a non-clear vertex behind
+			return (step == Pos(-dir.x, dir.y) && !table.clear(pos - Pos(dir.x,0)) && table.clear(pos + step)) ||
+			       (step == Pos(dir.x, -dir.y) && !table.clear(pos - Pos(0,dir.y)) && table.clear(pos + step));
+	};
+
+	// follows the straight line from pos until a vertex that must be expanded: a goal, one that
+	// is not clear, or one with a forced neighbor. Returns nullopt if there is none within `limit` steps.
+	auto scan = [&](Pos pos, const Pos& step, int limit) -> optional<Pos> {
+		dir4_t dir = dir4_of(step);
+		int n = 0;
+		while (n < limit)
+		{
+			if (is_goal(pos))
+				return pos;
+			int run = table.run(pos, dir);
+			if (run == 0)
+				return pos;
+
+			int advance = min({run, limit-n, max(1, steps_until_goal_box(pos, step))});
+			pos = pos + step*advance;
+			n += advance;
+		}
+		return nullopt;
+	};
+
+	// returns the next jump point when walking from `from` in direction `step`. The first step must be possible.
+	auto jump = [&](const Pos& from, const Pos& step) {
+		if (step.x == 0 || step.y == 0)
+		{
+			optional<Pos> jump_point = scan(from+step, step, MAX_JUMP-1);
+			return jump_point ? *jump_point : from + step*MAX_JUMP;
+		}
+
+		Pos horizontal(step.x, 0), vertical(0, step.y);
+		Pos pos = from + step;
+		for (int n = 1; n < MAX_JUMP; n++, pos = pos + step)
+		{
+			if (is_goal(pos) || !table.clear(pos) || is_forced(pos, step, Pos(-step.x, step.y)) || is_forced(pos, step, Pos(step.x, -step.y)))
+				return pos;
+			// pos is where a path might turn into a straight line towards a jump point
+			if (scan(pos+horizontal, horizontal, MAX_JUMP) || scan(pos+vertical, vertical, MAX_JUMP))
+				return pos;
+		}
+		return pos;
+	};
+
+	OpenList& openlist = search_openlist;
+	openlist.clear();
+
+	search.at(start).g_val = 0.;
+	openlist.push(search.at(start), start, 0.);
+
+	int n_iterations = 0;
+	while (optional<Entry> top = openlist.pop(search))
+	{
+		Entry current = *top;
+		n_iterations++;
+
+		if (current.f >= length_limit*OVERAPPROXIMATE) // this (and any subsequent) entry is guaranteed
+			break;                                 // to exceed the length_limit.
+
+		if (is_goal(current.pos))
+		{
+			// found goal. the predecessors are jump points, so fill in the tiles between them.
+			Pos p = current.pos;
+			result.push_back(p);
+			while (p != start)
+			{
+				Pos predecessor = search.at(p).predecessor;
+				Pos step = sign(predecessor - p);
+				while (p != predecessor)
 				{
-					openlist.update(succ.openlist_handle, Entry(successor, f));
+					p = p + step;
+					result.push_back(p);
 				}
-				else
+			}
+
+			reverse(result.begin(), result.end());
+			break;
+		}
+
+		search_t& cur = search.at(current.pos);
+		cur.in_closedlist = true;
+
+		// on a clear vertex, only the natural and forced neighbors need to be considered, because
+		// all others can be reached at least as well without passing through this vertex.
+		Pos dir = current.pos == start ? Pos(0,0) : sign(current.pos - cur.predecessor);
+		bool prune = dir != Pos(0,0) && table.clear(current.pos);
+
+		Pos steps[] = {Pos(-1,-1), Pos(0, -1), Pos(1,-1),
+		               Pos(-1, 0),             Pos(1, 0),
+		               Pos(-1, 1), Pos(0,  1), Pos(1, 1)};
+		for (const Pos& step : steps)
+		{
+			if (prune)
+			{
+				bool natural = step == dir || (dir.x != 0 && dir.y != 0 && (step == Pos(dir.x,0) || step == Pos(0,dir.y)));
+				if (!natural && !is_forced(current.pos, dir, step))
+					continue;
+			}
+			else if (!can_step(view, current.pos, step, size))
+				continue;
+
+			Pos successor = jump(current.pos, step);
+			auto& succ = search.at(successor);
+			if (succ.in_closedlist)
+				continue;
+
+			int n_steps = max(abs(successor.x - current.pos.x), abs(successor.y - current.pos.y));
+			double new_g = cur.g_val + n_steps * sqrt(step.x*step.x + step.y*step.y);
+
+			if (succ.opened && succ.g_val < new_g) // ignore this successor, when a better way is already known
+				continue;
+
+			succ.predecessor = current.pos;
+			succ.g_val = new_g;
+			openlist.push(succ, successor, new_g + heuristic(successor, end.center()));
+		}
+	}
+
+	#ifdef DEBUG_PATHFINDING
+	log << "took " << n_iterations << " iterations or " << (n_iterations / max(1.0, (start-end.center()).len())) << " it/dist" << endl;
+	#endif
+
+	return result;
+}
+
+
+/** how many vertices is_enclosed() may visit before it gives up */
+constexpr size_t ENCLOSURE_BUDGET = 4096;
+
+/** returns whether the vertices that can reach `goals` are fewer than `budget`, and do not include `start`.
+  * Then the goals are enclosed by obstacles, and can not be reached from start. */
+template <class View> static bool is_enclosed(View& view, const vector<Pos>& goals, const Pos& start, double size, size_t budget)
+{
+	SearchContext& search = search_context_reverse;
+	search.reset();
+
+	vector<Pos> todo;
+	for (const Pos& goal : goals)
+		if (!search.at(goal).opened)
+		{
+			search.at(goal).opened = true;
+			todo.push_back(goal);
+		}
+
+	size_t n_visited = todo.size();
+	while (!todo.empty())
+	{
+		Pos current = todo.back();
+		todo.pop_back();
+		if (current == start)
+			return false;
+
+		for (const Pos& step : STEPS)
+		{
+			Pos neighbor = current - step;
+			if (search.at(neighbor).opened || !can_step(view, neighbor, step, size))
+				continue;
+			if (++n_visited > budget)
+				return false;
+			search.at(neighbor).opened = true;
+			todo.push_back(neighbor);
+		}
+	}
+	return true;
+}
+
+vector< optional<double> > multi_target_distances(const Pos& start, const vector<Area_f>& ends, const WorldMap<walk_t>& map, double allowed_distance, double min_distance, double length_limit, double size)
+{
+	#ifdef DEBUG_PATHFINDING
+	Logger log("pathfinding");
+	#endif
+
+	log << "multi_target_distances from " << start.str() << " to " << ends.size() << " goals (allowed_distance=" << allowed_distance << ", min_distance=" << min_distance << ", length_limit="<<length_limit<<", size="<<size<<endl;
+
+	if (ceil(min_distance) >= allowed_distance)
+		throw invalid_argument("ceil(min_distance) must be smaller than allowed distance");
+
+	vector< optional<double> > result(ends.size());
+
+	Area view_area(start, start + Pos(1,1));
+	for (const Area_f& end : ends)
+		view_area = view_area.expand(goal_box(end, allowed_distance));
+	auto view = map.view(view_area.left_top, view_area.right_bottom, Pos(0,0));
+
+	// for every vertex that is a goal, the indices of the ends it belongs to. The search only
+	// ends early if all goals are found, so leave out those that are clearly unreachable.
+	unordered_map< Pos, vector<size_t> > goals;
+	size_t n_remaining = 0;
+	for (size_t i = 0; i < ends.size(); i++)
+	{
+		Area box = goal_box(ends[i], allowed_distance);
+		vector<Pos> vertices;
+		for (int x = box.left_top.x; x < box.right_bottom.x; x++)
+			for (int y = box.left_top.y; y < box.right_bottom.y; y++)
+			{
+				double dist = distance(Pos(x,y), ends[i]);
+				if (dist <= allowed_distance && dist >= min_distance)
+					vertices.push_back(Pos(x,y));
+			}
+
+		if (vertices.empty() || is_enclosed(view, vertices, start, size, ENCLOSURE_BUDGET))
+			continue;
+		for (const Pos& vertex : vertices)
+			goals[vertex].push_back(i);
+		n_remaining++;
+	}
+
+	SearchContext& search = search_context;
+	search.reset();
+	OpenList& openlist = search_openlist;
+	openlist.clear();
+
+	search.at(start).g_val = 0.;
+	openlist.push(search.at(start), start, 0.);
+
+	// plain Dijkstra: with several goals, there is no single direction to guide the search into.
+	int n_iterations = 0;
+	while (n_remaining > 0)
+	{
+		optional<Entry> top = openlist.pop(search);
+		if (!top || top->f > length_limit)
+			break;
+		Entry current = *top;
+		n_iterations++;
+
+		search_t& cur = search.at(current.pos);
+		cur.in_closedlist = true;
+
+		auto goal_iter = goals.find(current.pos);
+		if (goal_iter != goals.end())
+			for (size_t i : goal_iter->second)
+				if (!result[i].has_value())
 				{
-					verboselog << "(new)" << flush;
-					succ.openlist_handle = openlist.push(Entry(successor, f));
-					needs_cleanup.push_back(&succ);
+					result[i] = cur.g_val;
+					n_remaining--;
 				}
+
+		for (const Pos& step : STEPS)
+		{
+			if (!can_step(view, current.pos, step, size))
+				continue;
+
+			Pos successor = current.pos + step;
+			auto& succ = search.at(successor);
+			if (succ.in_closedlist)
+				continue;
+
+			double new_g = cur.g_val + step.len();
+			if (succ.opened && succ.g_val <= new_g)
+				continue;
+
+			succ.predecessor = current.pos;
+			succ.g_val = new_g;
+			openlist.push(succ, successor, new_g);
+		}
+	}
+
+	#ifdef DEBUG_PATHFINDING
+	log << "took " << n_iterations << " iterations, " << n_remaining << " goals were not reached" << endl;
+	#endif
+
+	return result;
+}
+
+vector<Pos> a_star_bidirectional(const Pos& start, const Area_f& end, const WorldMap<walk_t>& map, double allowed_distance, double min_distance, double length_limit, double size)
+{
+	return smooth_path(a_star_bidirectional_raw(start, end, map, allowed_distance, min_distance, length_limit, size), map, size);
+}
+
+vector<Pos> a_star_bidirectional_raw(const Pos& start, const Area_f& end, const WorldMap<walk_t>& map, double allowed_distance, double min_distance, double length_limit, double size)
+{
+	#ifdef DEBUG_PATHFINDING
+	Logger log("pathfinding");
+	#endif
+
+	log << "a_star_bidirectional from " << start.str() << " to " << end.str() << " (allowed_distance=" << allowed_distance << ", min_distance=" << min_distance << ", length_limit="<<length_limit<<", size="<<size<<endl;
+
+	if (ceil(min_distance) >= allowed_distance)
+		throw invalid_argument("ceil(min_distance) must be smaller than allowed distance");
+
+	Area box = goal_box(end, allowed_distance);
+	Area view_area = box.expand(start);
+	auto view = map.view(view_area.left_top, view_area.right_bottom, Pos(0,0));
+
+	// both halves are guided by the same potential, the average of the distance estimates to the
+	// goal and from the start. Then the search can stop as soon as the two lowest keys add up to
+	// the best path found so far.
+	auto potential = [&](const Pos& pos) {
+		return (max(0., distance(pos, end) - allowed_distance) - (pos - start).len()) / 2;
+	};
+
+	SearchContext* search[2] = { &search_context, &search_context_reverse };
+	OpenList* openlist[2] = { &search_openlist, &search_openlist_reverse };
+	for (int side = 0; side < 2; side++)
+	{
+		search[side]->reset();
+		openlist[side]->clear();
+	}
+
+	search[0]->at(start).g_val = 0.;
+	search[0]->at(start).predecessor = start;
+	openlist[0]->push(search[0]->at(start), start, potential(start));
+	for (int x = box.left_top.x; x < box.right_bottom.x; x++)
+		for (int y = box.left_top.y; y < box.right_bottom.y; y++)
+		{
+			Pos pos(x,y);
+			double dist = distance(pos, end);
+			if (dist <= allowed_distance && dist >= min_distance)
+			{
+				search_t& state = search[1]->at(pos);
+				state.g_val = 0.;
+				state.predecessor = pos; // the backward half's predecessors lead towards the goal
+				openlist[1]->push(state, pos, -potential(pos));
 			}
 		}
-		verboselog << endl;
+
+	double best_length = numeric_limits<double>::infinity();
+	Pos meeting_point;
+	if (search[1]->at(start).opened) // the start is a goal already
+	{
+		best_length = 0.;
+		meeting_point = start;
 	}
+	optional<Entry> top[2] = { openlist[0]->pop(*search[0]), openlist[1]->pop(*search[1]) };
 
-a_star_cleanup:
-	
-	for (walk_t* w : needs_cleanup)
+	int n_iterations = 0;
+	while (top[0] && top[1])
 	{
-		w->openlist_handle = pathfinding::openlist_handle_t();
-		w->in_closedlist = false;
+		// any path not found yet is at least this long
+		double lower_bound = top[0]->f + top[1]->f;
+		if (lower_bound >= best_length || lower_bound > length_limit)
+			break;
+		n_iterations++;
+
+		// expand the half with less work queued, so that a goal that is enclosed (or a start
+		// that is) is detected quickly.
+		int side = openlist[0]->size() <= openlist[1]->size() ? 0 : 1;
+		SearchContext& here = *search[side];
+		SearchContext& there = *search[1-side];
+		Pos current = top[side]->pos;
+		search_t& cur = here.at(current);
+		cur.in_closedlist = true;
+
+		for (const Pos& step : STEPS)
+		{
+			// the backward half walks the steps in reverse
+			Pos neighbor = side == 0 ? current + step : current - step;
+			if (!(side == 0 ? can_step(view, current, step, size) : can_step(view, neighbor, step, size)))
+				continue;
+
+			auto& succ = here.at(neighbor);
+			if (succ.in_closedlist)
+				continue;
+
+			double new_g = cur.g_val + step.len();
+			if (succ.opened && succ.g_val <= new_g)
+				continue;
+
+			succ.predecessor = current;
+			succ.g_val = new_g;
+			openlist[side]->push(succ, neighbor, new_g + (side == 0 ? potential(neighbor) : -potential(neighbor)));
+
+			const search_t& other = there.at(neighbor);
+			if (other.opened && new_g + other.g_val < best_length)
+			{
+				best_length = new_g + other.g_val;
+				meeting_point = neighbor;
+			}
+		}
+
+		top[side] = openlist[side]->pop(here);
+	}
+
+	vector<Pos> result;
+	if (best_length <= length_limit)
+	{
+		for (Pos p = meeting_point; p != start; p = search[0]->at(p).predecessor)
+			result.push_back(p);
+		result.push_back(start);
+		reverse(result.begin(), result.end());
+		for (Pos p = meeting_point; search[1]->at(p).predecessor != p; )
+		{
+			p = search[1]->at(p).predecessor;
+			result.push_back(p);
+		}
 	}
 
 	#ifdef DEBUG_PATHFINDING
-	log << "took " << n_iterations << " iterations or " << (n_iterations / max(1.0, (start-end.center()).len())) << " it/dist" << endl;
+	log << "took " << n_iterations << " iterations, found a path of length " << best_length << endl;
 	#endif
 
 	return result;
@@ -18,14 +18,28 @@
 
 #pragma once
 #include <vector>
+#include <optional>
 #include <boost/heap/binomial_heap.hpp>
 #include <limits>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
 #include "pos.hpp"
 #include "area.hpp"
 #include "worldmap.hpp"
+#include "defines.h"
+
+/* Selects the open list used by a_star(). By default, it is a 4-ary heap in a flat vector
+ * (see dary_heap.hpp), which handles decrease-key lazily by pushing the tile again and
+ * skipping the outdated entry when it is popped. Defining this uses boost's binomial heap
+ * with real decrease-key instead. See eval/openlist for a comparison. */
+//#define PATHFINDING_BINOMIAL_OPENLIST
 
 namespace pathfinding
 {
+	class JumpTable;
+	class Landmarks;
+
 	struct Entry
 	{
 		Pos pos;
@@ -36,37 +50,211 @@ namespace pathfinding
 	};
 
 	typedef boost::heap::binomial_heap<Entry>::handle_type openlist_handle_t;
+
+	/** a distance between 0 and 1 tiles, in fixed point with a precision of 1/256 tiles. Factorio's
+	  * positions and collision boxes are multiples of 1/256 tiles, so this is lossless for the margins
+	  * calculated from them. Behaves like a double. */
+	class margin_t
+	{
+		public:
+			static constexpr int ONE = 256;
+
+			margin_t(double value = 1.) { *this = value; }
+			margin_t& operator=(double value)
+			{
+				raw_value = uint16_t(std::lround(std::clamp(value, 0., 1.) * ONE));
+				return *this;
+			}
+			operator double() const { return raw_value / double(ONE); }
+
+			uint16_t raw() const { return raw_value; }
+			static margin_t from_raw(uint16_t raw) { margin_t result; result.raw_value = std::min(raw, uint16_t(ONE)); return result; }
+
+		private:
+			uint16_t raw_value;
+	};
 	
+	/** the static walkability information of a tile. This is kept small (12 bytes), because
+	  * there is one for every tile that has ever been seen. The per-search state of a_star()
+	  * is kept separately in search_t. */
 	struct walk_t
 	{
-		bool known;
-		bool can_walk;
-		bool can_cross;
-		int tree_amount;
-		double margins[4];
+		bool known : 1;
+		bool can_walk : 1;
+		bool can_cross : 1;
+		uint16_t tree_amount;
+		margin_t margins[4];
+
+		walk_t() : known(false), can_walk(true), can_cross(true), tree_amount(0) {}
+		bool water() const { return known && !can_walk; } // FIXME this is a hack
+		bool land() const { return known && can_walk; } // FIXME same
+	};
+
+	/** returns whether a character of width `size` can walk from `pos` to its neighbor `pos+step` */
+	template <class View> bool can_step(View& view, const Pos& pos, const Pos& step, double size)
+	{
+		Pos successor = pos + step;
+
+		if (step.x == 0) // walking in vertical direction
+		{
+			auto x = pos.x;
+			auto y = std::min(pos.y, successor.y);
+			return view.at(x-1, y).margins[EAST] >= size/2 && view.at(x, y).margins[WEST] >= size/2 && view.at(x-1,y).can_walk && view.at(x,y).can_walk;
+		}
+		else if (step.y == 0) // walking in horizontal direction
+		{
+			auto x = std::min(pos.x, successor.x);
+			auto y = pos.y;
+			return view.at(x, y-1).margins[SOUTH] >= size/2 && view.at(x, y).margins[NORTH] >= size/2 && view.at(x,y-1).can_walk && view.at(x,y).can_walk;
+		}
+		else // walking diagonally
+		{
+			auto x = std::min(pos.x, successor.x);
+			auto y = std::min(pos.y, successor.y);
+			const auto& v = view.at(x,y);
+			return (v.margins[0]>=0.5 && v.margins[1]>=0.5 && v.margins[2]>=0.5 && v.margins[3]>=0.5) && v.can_walk && (view.at(x+step.x, y).can_walk || view.at(x, y+step.y).can_walk);
+		}
+	}
 
+	/** The mod walks from one waypoint to the next in one of the 8 directions only: diagonally
+	  * until one coordinate matches, and straight from there on. This returns the length of
+	  * that walk from `a` to `b`. */
+	inline double octile_distance(const Pos& a, const Pos& b)
+	{
+		int dx = std::abs(b.x - a.x), dy = std::abs(b.y - a.y);
+		return std::min(dx,dy) * std::sqrt(2.) + std::abs(dx-dy);
+	}
 
-		double g_val;
+	/** returns whether a character of width `size` can walk from `from` to `to` the way the mod does,
+	  * see octile_distance() */
+	template <class View> bool can_walk_octile(View& view, Pos from, const Pos& to, double size)
+	{
+		Pos diagonal(to.x > from.x ? 1 : -1, to.y > from.y ? 1 : -1);
+		while (from.x != to.x && from.y != to.y)
+		{
+			if (!can_step(view, from, diagonal, size))
+				return false;
+			from = from + diagonal;
+		}
+
+		Pos straight(to.x > from.x ? 1 : to.x < from.x ? -1 : 0, to.y > from.y ? 1 : to.y < from.y ? -1 : 0);
+		while (from != to)
+		{
+			if (!can_step(view, from, straight, size))
+				return false;
+			from = from + straight;
+		}
+		return true;
+	}
+
+	/** returns a box that contains every vertex within allowed_distance of `end` */
+	inline Area goal_box(const Area_f& end, double allowed_distance)
+	{
+		return Area(
+			Pos(int(std::floor(end.left_top.x - allowed_distance)), int(std::floor(end.left_top.y - allowed_distance))),
+			Pos(int(std::ceil(end.right_bottom.x + allowed_distance)) + 1, int(std::ceil(end.right_bottom.y + allowed_distance)) + 1) );
+	}
+
+	/** per-tile state of a running a_star() search */
+	struct search_t
+	{
+		double g_val = 0.;
 		Pos predecessor;
+		#ifdef PATHFINDING_BINOMIAL_OPENLIST
 		openlist_handle_t openlist_handle;
-		bool in_closedlist=false;
+		#endif
+		bool opened = false; // has been pushed into the open list
+		bool in_closedlist = false;
+	};
 
-		walk_t() : known(false), can_walk(true), can_cross(true), tree_amount(0) {}
-		bool water() const { return known && !can_walk; } // FIXME this is a hack
-		bool land() const { return known && can_walk; } // FIXME same
+	/** Holds the search_t of all tiles touched by a search, so that the walk map itself is
+	  * only read during pathfinding.
+	  *
+	  * The scratch chunks are kept across searches, and each tile is stamped with the
+	  * search ("generation") that last wrote it. Starting a new search just increments the
+	  * generation, which invalidates all tiles at once without touching them.
+	  * A SearchContext must only be used by one thread at a time; a_star() uses one per thread.
+	  */
+	class SearchContext
+	{
+		public:
+			/** starts a new search, forgetting everything about the previous one */
+			void reset()
+			{
+				if (++generation == 0) // wrapped around, old stamps could become valid again
+				{
+					tiles = WorldMap<stamped_t>();
+					generation = 1;
+				}
+			}
+
+			/** returns the state of `pos` in the current search, which is default-initialized
+			  * when accessed for the first time after reset() */
+			search_t& at(const Pos& pos)
+			{
+				stamped_t& tile = tiles.at(pos);
+				if (tile.generation != generation)
+				{
+					tile.generation = generation;
+					tile.state = search_t();
+				}
+				return tile.state;
+			}
+
+			/** frees all scratch memory */
+			void clear() { tiles = WorldMap<stamped_t>(); }
+
+		private:
+			struct stamped_t
+			{
+				uint32_t generation = 0;
+				search_t state;
+			};
+			WorldMap<stamped_t> tiles;
+			uint32_t generation = 1;
 	};
 
 }
 
+/** removes the waypoints in the middle of straight lines */
 std::vector<Pos> cleanup_path(const std::vector<Pos>& path);
+/** like cleanup_path(), but also skips waypoints that the mod can walk past directly, so that
+  * staircases become one diagonal and one straight line. See pathfinding::can_walk_octile(). */
+std::vector<Pos> smooth_path(const std::vector<Pos>& path, const WorldMap<pathfinding::walk_t>& map, double size);
 /* FIXME maybe deprecate those in favor of FactorioGame::blah? */
 
 /** calculates a path from start into the disc around end, with outer radius allowed_distance
   * and inner radius min_distance. If length_limit is positive, the search will abort early
   * if the path is guaranteed to be longer than length_limit. Size specifies the width of
-  * the character; 0.5 is usually a good value. */
-std::vector<Pos> a_star(const Pos& start, const Area_f& end, WorldMap<pathfinding::walk_t>& map, double allowed_distance=1., double min_distance=0., double length_limit=std::numeric_limits<double>::infinity(), double size=0.5);
-std::vector<Pos> a_star_raw(const Pos& start, const Area_f& end, WorldMap<pathfinding::walk_t>& map, double allowed_distance=1., double min_distance=0., double length_limit=std::numeric_limits<double>::infinity(), double size=0.5);
+  * the character; 0.5 is usually a good value. The map is only read, so several searches
+  * may run concurrently in different threads. */
+std::vector<Pos> a_star(const Pos& start, const Area_f& end, const WorldMap<pathfinding::walk_t>& map, double allowed_distance=1., double min_distance=0., double length_limit=std::numeric_limits<double>::infinity(), double size=0.5);
+std::vector<Pos> a_star_raw(const Pos& start, const Area_f& end, const WorldMap<pathfinding::walk_t>& map, double allowed_distance=1., double min_distance=0., double length_limit=std::numeric_limits<double>::infinity(), double size=0.5);
+
+/** like a_star(), but uses jump point search on the clear parts of the map (see JumpTable), which
+  * skips over open areas instead of expanding every tile. Near obstacles, every tile is expanded like
+  * in a_star(). `jumps` must be kept up to date with `map`. With an exact heuristic, the paths are as
+  * long as a_star()'s, but ties between equally long paths may be broken differently. */
+std::vector<Pos> a_star_jps(const Pos& start, const Area_f& end, const WorldMap<pathfinding::walk_t>& map, const pathfinding::JumpTable& jumps, double allowed_distance=1., double min_distance=0., double length_limit=std::numeric_limits<double>::infinity(), double size=0.5);
+std::vector<Pos> a_star_jps_raw(const Pos& start, const Area_f& end, const WorldMap<pathfinding::walk_t>& map, const pathfinding::JumpTable& jumps, double allowed_distance=1., double min_distance=0., double length_limit=std::numeric_limits<double>::infinity(), double size=0.5);
+
+/** like a_star(), but exact: instead of overestimating the direct line, the heuristic is the best of
+  * the lower bounds given by `landmarks` (see Landmarks) and the direct line. Around lakes, these
+  * bounds are much tighter than the direct line, so fewer tiles are expanded even though the
+  * heuristic is not inflated. For any size other than Landmarks::SIZE, only the direct line is used. */
+std::vector<Pos> a_star_alt(const Pos& start, const Area_f& end, const WorldMap<pathfinding::walk_t>& map, const pathfinding::Landmarks& landmarks, double allowed_distance=1., double min_distance=0., double length_limit=std::numeric_limits<double>::infinity(), double size=0.5);
+std::vector<Pos> a_star_alt_raw(const Pos& start, const Area_f& end, const WorldMap<pathfinding::walk_t>& map, const pathfinding::Landmarks& landmarks, double allowed_distance=1., double min_distance=0., double length_limit=std::numeric_limits<double>::infinity(), double size=0.5);
+
+/** calculates the lengths of the paths from start into each of the discs around `ends`, like a_star()
+  * would for each of them, but in a single search. A goal that can not be reached within length_limit
+  * gets nullopt. The lengths are exact, while a_star() trades some exactness for speed. */
+std::vector< std::optional<double> > multi_target_distances(const Pos& start, const std::vector<Area_f>& ends, const WorldMap<pathfinding::walk_t>& map, double allowed_distance=1., double min_distance=0., double length_limit=std::numeric_limits<double>::infinity(), double size=0.5);
+
+/** like a_star(), but searches from the start and from the goal at the same time, until they meet.
+  * This finds the shortest path, and it notices quickly if the goal is enclosed by obstacles, where
+  * a_star() has to explore everything around the start up to the length_limit. */
+std::vector<Pos> a_star_bidirectional(const Pos& start, const Area_f& end, const WorldMap<pathfinding::walk_t>& map, double allowed_distance=1., double min_distance=0., double length_limit=std::numeric_limits<double>::infinity(), double size=0.5);
+std::vector<Pos> a_star_bidirectional_raw(const Pos& start, const Area_f& end, const WorldMap<pathfinding::walk_t>& map, double allowed_distance=1., double min_distance=0., double length_limit=std::numeric_limits<double>::infinity(), double size=0.5);
 
-[[deprecated]] inline std::vector<Pos> a_star(const Pos& start, const Pos& end, WorldMap<pathfinding::walk_t>& map, double allowed_distance=1., double min_distance=0., double length_limit=std::numeric_limits<double>::infinity(), double size=0.5) { return a_star(start, Area_f(end,end), map, allowed_distance, min_distance, length_limit, size); }
-[[deprecated]] inline std::vector<Pos> a_star_raw(const Pos& start, const Pos& end, WorldMap<pathfinding::walk_t>& map, double allowed_distance=1., double min_distance=0., double length_limit=std::numeric_limits<double>::infinity(), double size=0.5) { return a_star_raw(start, Area_f(end,end), map, allowed_distance, min_distance, length_limit, size); }
+[[deprecated]] inline std::vector<Pos> a_star(const Pos& start, const Pos& end, const WorldMap<pathfinding::walk_t>& map, double allowed_distance=1., double min_distance=0., double length_limit=std::numeric_limits<double>::infinity(), double size=0.5) { return a_star(start, Area_f(end,end), map, allowed_distance, min_distance, length_limit, size); }
+[[deprecated]] inline std::vector<Pos> a_star_raw(const Pos& start, const Pos& end, const WorldMap<pathfinding::walk_t>& map, double allowed_distance=1., double min_distance=0., double length_limit=std::numeric_limits<double>::infinity(), double size=0.5) { return a_star_raw(start, Area_f(end,end), map, allowed_distance, min_distance, length_limit, size); }
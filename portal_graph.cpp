@@ -0,0 +1,380 @@
+/*
+ * Copyright (c) 2017, 2018 Florian Jung
+ *
+ * This file is part of factorio-bot.
+ *
+ * factorio-bot is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License,
+ * version 3, as published by the Free Software Foundation.
+ *
+ * factorio-bot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with factorio-bot. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+#include "portal_graph.hpp"
+#include "dary_heap.hpp"
+
+using namespace std;
+using namespace pathfinding;
+
+static const Pos STEPS[8] = { Pos(-1,-1), Pos(0,-1), Pos(1,-1), Pos(-1,0), Pos(1,0), Pos(-1,1), Pos(0,1), Pos(1,1) };
+
+LocalGraph::LocalGraph(const WorldMap<walk_t>& map, const Area& area_, double size_) : area(area_), size(size_)
+{
+	height = area.right_bottom.y - area.left_top.y;
+	int width = area.right_bottom.x - area.left_top.x;
+	can_step_mask.resize(size_t(width) * height);
+	update(map, area);
+}
+
+void LocalGraph::update(const WorldMap<walk_t>& map, const Area& changed)
+{
+	Area updated = changed.intersect(area);
+	if (updated.empty())
+		return;
+	auto view = map.view(updated.left_top - Pos(1,1), updated.right_bottom + Pos(1,1), Pos(0,0));
+
+	for (int x = updated.left_top.x; x < updated.right_bottom.x; x++)
+		for (int y = updated.left_top.y; y < updated.right_bottom.y; y++)
+		{
+			uint8_t mask = 0;
+			for (int i = 0; i < 8; i++)
+				if (can_step(view, Pos(x,y), STEPS[i], size))
+					mask |= uint8_t(1 << i);
+			can_step_mask[index(Pos(x,y))] = mask;
+		}
+}
+
+vector<float> LocalGraph::distances(const vector< pair<Pos,float> >& sources, bool reverse) const
+{
+	vector<float> dist(can_step_mask.size(), numeric_limits<float>::infinity());
+	DaryHeap<Entry> openlist;
+
+	for (const auto& [pos, d] : sources)
+		if (area.contains(pos) && d < dist[index(pos)])
+		{
+			dist[index(pos)] = d;
+			openlist.push(Entry(pos, d));
+		}
+
+	propagate(dist, openlist, reverse);
+	return dist;
+}
+
+void LocalGraph::repair(vector<float>& dist, const Pos& source, const Area& changed_, bool reverse) const
+{
+	const float INF = numeric_limits<float>::infinity();
+	Area changed = changed_.intersect(area);
+	if (changed.empty())
+		return;
+	// the vertices next to `changed` may have lost the vertex they were reached from
+	Area candidates = changed.expand(1).intersect(area);
+
+	// `pred` can step to `pos`, in the direction of the search
+	auto is_step = [&](const Pos& pred, const Pos& pos, int i) {
+		return bool(can_step_mask[index(reverse ? pos : pred)] & (1 << i));
+	};
+	auto predecessor = [&](const Pos& pos, int i) { return reverse ? pos + STEPS[i] : pos - STEPS[i]; };
+	auto successor = [&](const Pos& pos, int i) { return reverse ? pos - STEPS[i] : pos + STEPS[i]; };
+
+	// first, forget the distance of every vertex that can not be reached like before anymore.
+	// In the order of the old distances, a vertex keeps its distance if a predecessor that kept
+	// its own still leads there with the same length. Otherwise, its successors must be checked.
+	vector<uint8_t> orphaned(dist.size(), 0);
+	vector<uint8_t> checked(dist.size(), 0);
+	vector<Pos> orphans;
+	DaryHeap<Entry> openlist;
+	for (int x = candidates.left_top.x; x < candidates.right_bottom.x; x++)
+		for (int y = candidates.left_top.y; y < candidates.right_bottom.y; y++)
+			if (dist[index(Pos(x,y))] != INF)
+				openlist.push(Entry(Pos(x,y), dist[index(Pos(x,y))]));
+
+	while (!openlist.empty())
+	{
+		Pos pos = openlist.top().pos;
+		openlist.pop();
+		if (checked[index(pos)] || pos == source)
+			continue;
+		checked[index(pos)] = true;
+
+		bool supported = false;
+		for (int i = 0; i < 8 && !supported; i++)
+		{
+			Pos pred = predecessor(pos, i);
+			if (area.contains(pred) && !orphaned[index(pred)] && is_step(pred, pos, i) &&
+				dist[index(pred)] != INF && float(dist[index(pred)] + STEPS[i].len()) == dist[index(pos)])
+				supported = true;
+		}
+		if (supported)
+			continue;
+
+		orphaned[index(pos)] = true;
+		orphans.push_back(pos);
+		for (int i = 0; i < 8; i++)
+		{
+			Pos succ = successor(pos, i);
+			if (area.contains(succ) && !checked[index(succ)] && dist[index(succ)] != INF && dist[index(succ)] > dist[index(pos)])
+				openlist.push(Entry(succ, dist[index(succ)]));
+		}
+	}
+
+	// then, reach the orphans again from the vertices around them, and let the changed vertices
+	// pass on shorter distances, e.g. through a gap that has just opened.
+	for (const Pos& pos : orphans)
+		dist[index(pos)] = INF;
+	for (const Pos& pos : orphans)
+		for (int i = 0; i < 8; i++)
+		{
+			Pos pred = predecessor(pos, i);
+			if (area.contains(pred) && is_step(pred, pos, i))
+				dist[index(pos)] = min(dist[index(pos)], float(dist[index(pred)] + STEPS[i].len()));
+		}
+	for (const Pos& pos : orphans)
+		if (dist[index(pos)] != INF)
+			openlist.push(Entry(pos, dist[index(pos)]));
+	for (int x = changed.left_top.x; x < changed.right_bottom.x; x++)
+		for (int y = changed.left_top.y; y < changed.right_bottom.y; y++)
+			if (dist[index(Pos(x,y))] != INF)
+				openlist.push(Entry(Pos(x,y), dist[index(Pos(x,y))]));
+
+	propagate(dist, openlist, reverse);
+}
+
+void LocalGraph::propagate(vector<float>& dist, DaryHeap<Entry>& openlist, bool reverse) const
+{
+	while (!openlist.empty())
+	{
+		Entry current = openlist.top();
+		openlist.pop();
+		if (current.f > dist[index(current.pos)])
+			continue; // outdated entry
+
+		for (int i = 0; i < 8; i++)
+		{
+			// going backwards, we need the step from the neighbor to current instead
+			Pos neighbor = reverse ? current.pos - STEPS[i] : current.pos + STEPS[i];
+			if (!area.contains(neighbor))
+				continue;
+			if (!(can_step_mask[index(reverse ? neighbor : current.pos)] & (1 << i)))
+				continue;
+
+			float d = float(current.f + STEPS[i].len());
+			if (d < dist[index(neighbor)])
+			{
+				dist[index(neighbor)] = d;
+				openlist.push(Entry(neighbor, d));
+			}
+		}
+	}
+}
+
+float LocalGraph::border_distance(const vector<float>& dist) const
+{
+	float result = numeric_limits<float>::infinity();
+	for (int x = area.left_top.x; x < area.right_bottom.x; x++)
+	{
+		result = min(result, dist[index(Pos(x, area.left_top.y))]);
+		result = min(result, dist[index(Pos(x, area.right_bottom.y-1))]);
+	}
+	for (int y = area.left_top.y; y < area.right_bottom.y; y++)
+	{
+		result = min(result, dist[index(Pos(area.left_top.x, y))]);
+		result = min(result, dist[index(Pos(area.right_bottom.x-1, y))]);
+	}
+	return result;
+}
+
+vector<Pos> LocalGraph::descend(const vector<float>& dist, const Pos& pos, bool reverse) const
+{
+	vector<Pos> result;
+	if (!area.contains(pos) || dist[index(pos)] == numeric_limits<float>::infinity())
+		return result;
+
+	// distances() has set every reachable vertex to exactly float(dist[predecessor] + step length),
+	// so the predecessor can be found again, and the distances strictly decrease along the way.
+	Pos current = pos;
+	result.push_back(current);
+	while (true)
+	{
+		Pos best_pos = current;
+		for (int i = 0; i < 8; i++)
+		{
+			Pos neighbor = reverse ? current + STEPS[i] : current - STEPS[i];
+			if (!area.contains(neighbor))
+				continue;
+			if (!(can_step_mask[index(reverse ? current : neighbor)] & (1 << i)))
+				continue;
+
+			float d = float(dist[index(neighbor)] + STEPS[i].len());
+			if (d <= dist[index(current)] && dist[index(neighbor)] < dist[index(best_pos)])
+				best_pos = neighbor;
+		}
+
+		if (best_pos == current)
+			break; // this is a source
+		current = best_pos;
+		result.push_back(current);
+	}
+
+	if (!reverse)
+		std::reverse(result.begin(), result.end());
+	return result;
+}
+
+const PortalGraph::node_t* PortalGraph::cluster_t::find(const Pos& pos) const
+{
+	for (const node_t& node : nodes)
+		if (node.pos == pos)
+			return &node;
+	return nullptr;
+}
+
+void PortalGraph::invalidate(const Area& area)
+{
+	// the steps from and across the border of a chunk depend on the tiles next to it.
+	Pos lefttop = Pos::tile_to_chunk(area.left_top - Pos(2,2));
+	Pos rightbot = Pos::tile_to_chunk_ceil(area.right_bottom + Pos(3,3));
+
+	lock_guard<mutex> lock(clusters_mutex);
+	for (int x = lefttop.x; x < rightbot.x; x++)
+		for (int y = lefttop.y; y < rightbot.y; y++)
+		{
+			auto it = clusters.find(Pos(x,y));
+			if (it != clusters.end())
+				it->second->valid = false;
+		}
+}
+
+void PortalGraph::clear()
+{
+	lock_guard<mutex> lock(clusters_mutex);
+	clusters.clear();
+}
+
+const PortalGraph::cluster_t& PortalGraph::cluster(const WorldMap<walk_t>& map, const Pos& chunkpos) const
+{
+	lock_guard<mutex> lock(clusters_mutex);
+	unique_ptr<cluster_t>& cluster = clusters[chunkpos];
+	if (cluster == nullptr)
+		cluster = make_unique<cluster_t>();
+	if (!cluster->valid)
+		compute(map, chunkpos, *cluster);
+	return *cluster;
+}
+
+void PortalGraph::compute(const WorldMap<walk_t>& map, const Pos& chunkpos, cluster_t& cluster)
+{
+	Pos origin = Pos::chunk_to_tile(chunkpos);
+	auto view = map.view(origin - Pos(2,2), origin + Pos(34,34), Pos(0,0));
+
+	// find the portals on each border. The neighboring chunk finds the same entrances on its side,
+	// because straight steps are possible in both directions or in none.
+	struct portal_t
+	{
+		Pos inner;
+		Pos outer;
+		bool can_cross; // from inner to outer; the other chunk might only be able to cross in the opposite direction
+	};
+	vector<portal_t> portals;
+	struct border_t { Pos first; Pos along; Pos out; };
+	const border_t borders[4] = {
+		{ origin,               Pos(1,0), Pos(0,-1) }, // NORTH
+		{ origin + Pos(31,0),   Pos(0,1), Pos(1,0)  }, // EAST
+		{ origin + Pos(0,31),   Pos(1,0), Pos(0,1)  }, // SOUTH
+		{ origin,               Pos(0,1), Pos(-1,0) }  // WEST
+	};
+	for (const border_t& border : borders)
+	{
+		int i = 0;
+		while (i < 32)
+		{
+			if (!can_step(view, border.first + border.along*i, border.out, SIZE))
+			{
+				i++;
+				continue;
+			}
+
+			int begin = i;
+			while (i < 32 && can_step(view, border.first + border.along*i, border.out, SIZE))
+				i++;
+			int end = i;
+
+			vector<int> offsets;
+			if (end - begin < 6)
+				offsets.push_back((begin + end) / 2);
+			else
+			{
+				for (int j = begin; j < end-1; j += PORTAL_SPACING)
+					offsets.push_back(j);
+				offsets.push_back(end-1);
+			}
+
+			for (int j : offsets)
+			{
+				Pos inner = border.first + border.along*j;
+				portals.push_back(portal_t{inner, inner + border.out, true});
+			}
+		}
+
+		// a diagonal step can squeeze between two obstacles that block all straight steps around
+		// it. Those need a portal of their own, unless two straight steps can go around the corner.
+		// Both sides agree on this, because straight steps are symmetric, but the diagonal step
+		// itself may only be possible in one direction.
+		for (int i = 0; i < 32; i++)
+			for (int sign : {-1, 1})
+			{
+				Pos inner = border.first + border.along*i;
+				Pos side = border.along*sign;
+				Pos step = border.out + side;
+				bool forward = can_step(view, inner, step, SIZE);
+				if (!forward && !can_step(view, inner+step, Pos(0,0)-step, SIZE))
+					continue;
+				if ((can_step(view, inner, side, SIZE) && can_step(view, inner+side, border.out, SIZE)) ||
+				    (can_step(view, inner, border.out, SIZE) && can_step(view, inner+border.out, side, SIZE)))
+					continue;
+				portals.push_back(portal_t{inner, inner+step, forward});
+			}
+	}
+
+	cluster.nodes.clear();
+	for (const portal_t& portal : portals)
+	{
+		node_t* node = nullptr;
+		for (node_t& existing : cluster.nodes) // vertices in the corners can be on two borders
+			if (existing.pos == portal.inner)
+				node = &existing;
+		if (node == nullptr)
+		{
+			cluster.nodes.push_back(node_t{portal.inner, {}});
+			node = &cluster.nodes.back();
+		}
+
+		bool known = false;
+		for (const edge_t& edge : node->edges)
+			if (edge.to == portal.outer)
+				known = true;
+		if (portal.can_cross && !known)
+			node->edges.push_back(edge_t{portal.outer, float((portal.outer - portal.inner).len())});
+	}
+
+	// connect the nodes within the chunk
+	LocalGraph graph(map, Area(origin, origin + Pos(32,32)), SIZE);
+	for (node_t& node : cluster.nodes)
+	{
+		vector<float> dist = graph.distances({{node.pos, 0.f}}, false);
+		for (const node_t& other : cluster.nodes)
+			if (&other != &node && dist[graph.index(other.pos)] < numeric_limits<float>::infinity())
+				node.edges.push_back(edge_t{other.pos, dist[graph.index(other.pos)]});
+	}
+
+	cluster.valid = true;
+}
@@ -0,0 +1,144 @@
+/*
+ * Copyright (c) 2017, 2018 Florian Jung
+ *
+ * This file is part of factorio-bot.
+ *
+ * factorio-bot is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License,
+ * version 3, as published by the Free Software Foundation.
+ *
+ * factorio-bot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with factorio-bot. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <cstdint>
+#include <algorithm>
+
+#include "pathfinding.hpp"
+#include "dary_heap.hpp"
+#include "worldmap.hpp"
+#include "pos.hpp"
+#include "area.hpp"
+
+namespace pathfinding
+{
+	/** The possible steps between the vertices of a rectangle, for running Dijkstra's
+	  * algorithm on them without ever leaving the rectangle. */
+	class LocalGraph
+	{
+		public:
+			LocalGraph(const WorldMap<walk_t>& map, const Area& area, double size);
+
+			/** returns the length of the shortest path from any of the `sources` (starting with
+			  * the given distance) to each vertex in the area, indexed by index(). If `reverse`
+			  * is set, these are the lengths of the shortest paths from each vertex to any source
+			  * instead. Unreachable vertices are infinitely far away. */
+			std::vector<float> distances(const std::vector< std::pair<Pos,float> >& sources, bool reverse) const;
+
+			/** re-reads the vertices in `changed` from the map, e.g. after the tiles there have changed */
+			void update(const WorldMap<walk_t>& map, const Area& changed);
+
+			/** fixes `dist`, as returned by distances() with the same `reverse` and a single source,
+			  * after update() has changed the vertices in `changed`. Only the vertices whose shortest
+			  * path led through `changed`, and those that can now be reached faster, are visited again.
+			  * The source must still be able to move. */
+			void repair(std::vector<float>& dist, const Pos& source, const Area& changed, bool reverse) const;
+
+			/** follows `dist`, as returned by distances() with the same `reverse`, from `pos` back to
+			  * the closest source, and returns the vertices in walking order: from `pos` to the source
+			  * if `reverse` is set, or from the source to `pos` otherwise. Returns an empty path if
+			  * `pos` is unreachable. */
+			std::vector<Pos> descend(const std::vector<float>& dist, const Pos& pos, bool reverse) const;
+
+			/** the smallest of `dist`, as returned by distances(), on the outermost vertices of the
+			  * area. Every path that leaves the area steps out from one of them. */
+			float border_distance(const std::vector<float>& dist) const;
+			/** the direct line from `pos`, within the area, to the closest tile outside of it. Paths
+			  * that leave the area are at least this long from there. */
+			double distance_to_outside(const Pos& pos) const
+			{
+				return std::min({ pos.x - area.left_top.x + 1, area.right_bottom.x - pos.x,
+				                  pos.y - area.left_top.y + 1, area.right_bottom.y - pos.y });
+			}
+
+			/** whether a character at `pos` can step anywhere at all */
+			bool can_move(const Pos& pos) const { return can_step_mask[index(pos)] != 0; }
+
+			size_t index(const Pos& pos) const { return size_t(pos.x - area.left_top.x) * height + (pos.y - area.left_top.y); }
+			const Area area;
+
+		private:
+			/** runs Dijkstra's algorithm from the vertices in `openlist`, lowering `dist` where possible */
+			void propagate(std::vector<float>& dist, DaryHeap<Entry>& openlist, bool reverse) const;
+
+			int height;
+			double size;
+			std::vector<uint8_t> can_step_mask; // bit i is set if the vertex can step to its neighbor in direction STEPS[i]
+	};
+
+	/** The abstract graph for hierarchical pathfinding (HPA*), which treats every chunk as one cluster.
+	  *
+	  * Consecutive vertices on a chunk border, from which a straight step across it is possible,
+	  * form an entrance. Short entrances get one portal in their middle, longer ones get one at
+	  * both ends and every PORTAL_SPACING vertices in between. The vertices on both sides of a
+	  * portal are nodes of the graph, connected by the step across. All nodes of a chunk are
+	  * connected with the length of the shortest path between them that stays within the chunk.
+	  *
+	  * The graph is only valid for characters of width SIZE. Like JumpTable, the chunks are computed
+	  * lazily from the walk map, and everything that depends on changed tiles must be invalidate()d.
+	  * Lookups may happen from several threads at once, but not concurrently with invalidate().
+	  */
+	class PortalGraph
+	{
+		public:
+			static constexpr double SIZE = 0.5;
+			static constexpr int PORTAL_SPACING = 8;
+
+			struct edge_t
+			{
+				Pos to;
+				float cost;
+			};
+
+			struct node_t
+			{
+				Pos pos;
+				std::vector<edge_t> edges; // to the other nodes of the chunk, and across the border
+			};
+
+			struct cluster_t
+			{
+				bool valid = false;
+				std::vector<node_t> nodes;
+
+				/** returns the node at `pos`, or nullptr if there is none */
+				const node_t* find(const Pos& pos) const;
+			};
+
+			/** returns the cluster of the chunk at chunk coordinates `chunkpos`, (re)computing it if necessary */
+			const cluster_t& cluster(const WorldMap<walk_t>& map, const Pos& chunkpos) const;
+
+			/** marks everything that depends on the tiles in `area` as outdated */
+			void invalidate(const Area& area);
+			/** forgets everything, e.g. because the whole walk map was replaced */
+			void clear();
+
+		private:
+			mutable std::mutex clusters_mutex;
+			mutable std::unordered_map< Pos, std::unique_ptr<cluster_t> > clusters;
+
+			static void compute(const WorldMap<walk_t>& map, const Pos& chunkpos, cluster_t& cluster);
+	};
+}
@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2017, 2018 Florian Jung
+ *
+ * This file is part of factorio-bot.
+ *
+ * factorio-bot is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License,
+ * version 3, as published by the Free Software Foundation.
+ *
+ * factorio-bot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with factorio-bot. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <stdexcept>
+
+/** Interning table for prototypes (anything with a `name` and a dense `id`).
+  *
+  * Prototypes are added in id order while the static data is read. Once all of them
+  * are known, freeze() sorts the names, and from then on, find() and at() look up
+  * a name by binary search on string_views, without hashing or allocating.
+  * Per-prototype data can be stored in plain vectors indexed by the prototype's id.
+  */
+template <typename Proto> class PrototypeIndex
+{
+	public:
+		/** adds `proto`, whose id must equal size(). */
+		void add(const Proto* proto)
+		{
+			if (proto->id != by_id.size())
+				throw std::logic_error("PrototypeIndex::add(): prototype ids must be dense");
+			by_id.push_back(proto);
+			frozen = false;
+		}
+
+		void freeze()
+		{
+			by_name.clear();
+			by_name.reserve(by_id.size());
+			for (const Proto* proto : by_id)
+				by_name.emplace_back(proto->name, proto);
+			std::sort(by_name.begin(), by_name.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+			frozen = true;
+		}
+		bool is_frozen() const { return frozen; }
+
+		/** returns nullptr if there is no prototype called `name`. Only valid after freeze(). */
+		const Proto* find(std::string_view name) const
+		{
+			auto it = std::lower_bound(by_name.begin(), by_name.end(), name, [](const auto& entry, std::string_view n) { return entry.first < n; });
+			if (it != by_name.end() && it->first == name)
+				return it->second;
+			return nullptr;
+		}
+
+		/** like find(), but throws std::out_of_range if there is no such prototype. */
+		const Proto& at(std::string_view name) const
+		{
+			if (const Proto* proto = find(name))
+				return *proto;
+			throw std::out_of_range("unknown prototype '"+std::string(name)+"'");
+		}
+
+		const Proto* operator[](size_t id) const { return by_id[id]; }
+		size_t size() const { return by_id.size(); }
+
+	private:
+		std::vector<const Proto*> by_id;
+		std::vector< std::pair<std::string_view, const Proto*> > by_name; // sorted by name. the views point into the prototypes.
+		bool frozen = false;
+};
@@ -33,6 +33,7 @@
 #include <utility>
 #include <memory>
 #include <limits>
+#include <cmath>
 #include <optional>
 
 #include "logging.hpp"
@@ -802,6 +803,15 @@ void Scheduler::dump()
 }
 
 
+static Clock::duration path_walk_duration(double path_length) // FIXME move this somewhere else
+{
+	return chrono::duration_cast<Clock::duration>(
+		chrono::duration<float>(
+			path_length / WALKING_SPEED
+		)
+	);
+}
+
 /** Checks a schedule using operator(), while caching and reusing pathfinding results. */
 struct ScheduleChecker
 {
@@ -946,8 +956,14 @@ Scheduler::schedule_t Scheduler::calculate_schedule(const item_allocation_t& tas
 {
 	Logger log("calculate_schedule");
 	const Player& player = game->players[player_idx];
-	// FIXME: use proper calculation function
-	ScheduleChecker check_schedule(player.position, [](Pos a, Pos b, float /*radius*/) { return std::chrono::duration_cast<Clock::duration>(std::chrono::milliseconds(200) * (a-b).len()); });
+	ScheduleChecker check_schedule(player.position, [this](Pos a, Pos b, float radius) {
+		if (!std::isfinite(radius))
+			return Clock::duration::zero();
+		double length = game->pathfinder.travel_distance(a, Area_f(b,b), radius);
+		if (!std::isfinite(length))
+			length = max(0., (a-b).len() - radius); // unreachable; it might become reachable once more of the map is known
+		return path_walk_duration(length);
+	});
 	schedule_t schedule;
 	
 	for (const auto& [prio, pending_task]  : pending_tasks)
@@ -1027,28 +1043,27 @@ Scheduler::schedule_t Scheduler::calculate_schedule(const item_allocation_t& tas
 
 
 
-static double path_length(const vector<Pos>& path) // FIXME move this somewhere else
-{
-	double sum = 0.;
-	for (size_t i=1; i<path.size(); i++)
-		sum += (path[i-1]-path[i]).len();
-	return sum;
-}
-
-static Clock::duration path_walk_duration(const vector<Pos>& path) // FIXME move this somewhere else
+static Clock::duration walk_duration_approx(const Pos& start, const Pos& end)
 {
 	return chrono::duration_cast<Clock::duration>(
 		chrono::duration<float>(
-			path_length(path) / WALKING_SPEED
+			(start-end).len() / WALKING_SPEED
 		)
 	);
 }
 
-static Clock::duration walk_duration_approx(const Pos& start, const Pos& end)
+/** a lower bound for the walking time like walk_duration_approx(), but also by the distance fields
+  * of a hub close to both positions, if there is one. Unlike the direct line, this does not grow
+  * with the distance from the player, so it can only rule out single candidates. */
+static Clock::duration walk_duration_estimate(const pathfinding::Pathfinder& pathfinder, const Pos& start, const Pos& end)
 {
+	double distance = (start-end).len();
+	if (optional<double> estimate = pathfinder.distance_estimate(start, end))
+		distance = max(distance, *estimate);
+
 	return chrono::duration_cast<Clock::duration>(
 		chrono::duration<float>(
-			(start-end).len() / WALKING_SPEED
+			distance / WALKING_SPEED
 		)
 	);
 }
@@ -1060,6 +1075,68 @@ static double walk_distance_in_time(Clock::duration time) // FIXME move this som
 	return seconds * WALKING_SPEED;
 }
 
+/** Calculates the walking distances from one position to candidates that are asked for one after
+  * another. A single multi-target search answers the next few nearby candidates at once, and is only
+  * repeated when the start position or the length limit changes, or when the batch runs out.
+  * Candidates farther away than BATCH_RADIUS get a search of their own. */
+class DistanceBatch
+{
+	public:
+		static constexpr size_t BATCH_SIZE = 16;
+		static constexpr double BATCH_RADIUS = 64.;
+
+		DistanceBatch(const pathfinding::Pathfinder& pathfinder_, double allowed_distance_) : pathfinder(pathfinder_), allowed_distance(allowed_distance_) {}
+
+		/** returns the length of the path from `from` to the entity at `first`, or nullopt if there
+		  * is none within `length_limit`. The entities from `first` to `last` that satisfy
+		  * `is_candidate` are expected to be asked for next. */
+		template <class Iterator, class Predicate>
+		optional<double> path_length(const Pos& from, Iterator first, Iterator last, Predicate is_candidate, double length_limit)
+		{
+			const Pos_f target = first->pos;
+			if ((target - from.to_double()).len() > BATCH_RADIUS)
+				return pathfinder.path_length(from, Area_f(target, target), allowed_distance, 0., length_limit);
+
+			auto iter = find_if(lengths.begin(), lengths.end(), [&](const auto& entry) { return entry.first == target; });
+			if (from != origin || length_limit != limit || iter == lengths.end())
+			{
+				vector<Area_f> ends;
+				double max_distance = 0.;
+				for (Iterator it = first; it != last && ends.size() < BATCH_SIZE; ++it)
+					if (it == first || (is_candidate(*it) && (it->pos - from.to_double()).len() <= BATCH_RADIUS))
+					{
+						ends.emplace_back(it->pos, it->pos);
+						max_distance = max(max_distance, (it->pos - from.to_double()).len());
+					}
+
+				// an unreachable candidate would make the search explore everything up to the length
+				// limit. Only go as far as needed for reasonable detours to the nearby candidates.
+				search_limit = min(length_limit, 2*max_distance + 32.);
+				vector< optional<double> > results = pathfinder.path_lengths(from, ends, allowed_distance, 0., search_limit);
+
+				lengths.clear();
+				for (size_t i = 0; i < ends.size(); i++)
+					lengths.emplace_back(ends[i].left_top, results[i]);
+				origin = from;
+				limit = length_limit;
+				iter = lengths.begin();
+			}
+
+			if (!iter->second.has_value() && search_limit < length_limit)
+				return pathfinder.path_length(from, Area_f(target, target), allowed_distance, 0., length_limit);
+			return iter->second;
+		}
+
+	private:
+		const pathfinding::Pathfinder& pathfinder;
+		double allowed_distance;
+
+		Pos origin;
+		double limit = 0.;
+		double search_limit = 0.;
+		vector< pair< Pos_f, optional<double> > > lengths;
+};
+
 template <typename Rep, typename Per>
 std::ostream& operator<<(std::ostream& os, const chrono::duration<Rep,Per>& dur)
 {
@@ -1109,12 +1186,18 @@ shared_ptr<Task> Scheduler::build_collector_task(const item_allocation_t& task_i
 	// the items
 	Pos last_pos = player.position;
 	const int ALLOWED_DISTANCE = 2;
-	for (const auto& potential_container : world_entities.around(player.position))
+	auto is_container = [](const Entity& entity) { return entity.data_or_null<ContainerData>() != nullptr; };
+	DistanceBatch container_distances(game->pathfinder, ALLOWED_DISTANCE);
+	auto containers = world_entities.around(player.position);
+	for (auto container_iter = containers.begin(); container_iter != containers.end(); ++container_iter)
 	{
+		const auto& potential_container = *container_iter;
 		const ContainerData* data = potential_container.data_or_null<ContainerData>();
 		if (!data)
 			continue; // this is not a container
 		const auto& container = potential_container;
+		if (!game->pathfinder.may_reach(player.position.to_int(), Area_f(container.pos, container.pos), ALLOWED_DISTANCE))
+			continue; // the container is on another island
 
 		// exit condition: if the chest is outside of a
 		// (remaining_walktime + walktime(player.pos -> last_pos))-radius
@@ -1126,6 +1209,8 @@ shared_ptr<Task> Scheduler::build_collector_task(const item_allocation_t& task_i
 			log << "aborting due to duration approximation" << endl;
 			break;
 		}
+		if (walk_duration_estimate(game->pathfinder, last_pos, container.pos) + time_spent > max_duration)
+			continue; // e.g. because the container is behind a wall
 
 		bool relevant = false;
 		auto chest_action = make_shared<action::CompoundAction>();
@@ -1175,16 +1260,15 @@ shared_ptr<Task> Scheduler::build_collector_task(const item_allocation_t& task_i
 		{
 			log << "calculating path from " << last_pos.str() << " to " << container.pos.str() << " with a length limit of " << walk_distance_in_time(max_duration - time_spent) << endl;
 			// check if this chest is actually close enough
-			auto path = a_star(
-				last_pos, container.pos,
-				game->walk_map,
-				ALLOWED_DISTANCE, 0.,
+			// FIXME unreachable containers are treated as being free to visit
+			double length = container_distances.path_length(
+				last_pos, container_iter, containers.end(), is_container,
 				walk_distance_in_time(max_duration - time_spent)
-			);
+			).value_or(0.);
 			
-			log << "\t->" << path.size() << endl;
+			log << "\t->" << length << endl;
 
-			Clock::duration chest_duration = path_walk_duration(path); // FIXME maybe add a constant?
+			Clock::duration chest_duration = path_walk_duration(length); // FIXME maybe add a constant?
 			
 			if (time_spent + chest_duration <= max_duration)
 			{
@@ -1241,17 +1325,22 @@ shared_ptr<Task> Scheduler::build_collector_task(const item_allocation_t& task_i
 		}
 	}
 
+	auto is_mineable = [&mineable_entitytypes](const Entity& entity) { return contains_vec(mineable_entitytypes, entity.proto->type); };
+	DistanceBatch mineable_distances(game->pathfinder, ALLOWED_DISTANCE);
+	auto mineables = world_entities.around(player.position);
 	if (do_search_mineable_entities)
-		for (const auto& potential_mineable : world_entities.around(player.position))
-			if (contains_vec(mineable_entitytypes, potential_mineable.proto->type))
+		for (auto mineable_iter = mineables.begin(); mineable_iter != mineables.end(); ++mineable_iter)
+			if (is_mineable(*mineable_iter))
 			{
-				const auto& mineable = potential_mineable;
+				const auto& mineable = *mineable_iter;
 		
 				if (walk_duration_approx(last_pos, mineable.pos) + time_spent - walk_duration_approx(player.position, last_pos) > max_duration)
 				{
 					log << "aborting due to duration approximation" << endl;
 					break;
 				}
+				if (walk_duration_estimate(game->pathfinder, last_pos, mineable.pos) + time_spent > max_duration)
+					continue;
 
 				bool relevant = false;
 				auto new_missing_items = missing_items;
@@ -1291,16 +1380,15 @@ shared_ptr<Task> Scheduler::build_collector_task(const item_allocation_t& task_i
 
 				log << "calculating path from " << last_pos.str() << " to " << mineable.pos.str() << " with a length limit of " << walk_distance_in_time(max_duration - time_spent) << endl;
 				// check if this mineable is actually close enough
-				auto path = a_star(
-					last_pos, mineable.pos,
-					game->walk_map,
-					ALLOWED_DISTANCE, 0.,
+				// FIXME unreachable mineables are treated as being free to visit
+				double length = mineable_distances.path_length(
+					last_pos, mineable_iter, mineables.end(), is_mineable,
 					walk_distance_in_time(max_duration - time_spent)
-				);
+				).value_or(0.);
 
-				log << "\t->" << path.size() << endl;
+				log << "\t->" << length << endl;
 
-				Clock::duration mineable_duration = path_walk_duration(path) + std::chrono::seconds(3); // FIXME magic number for mining that entity :|
+				Clock::duration mineable_duration = path_walk_duration(length) + std::chrono::seconds(3); // FIXME magic number for mining that entity :|
 
 				if (time_spent + mineable_duration <= max_duration)
 				{
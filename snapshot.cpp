@@ -0,0 +1,436 @@
+/*
+ * Copyright (c) 2017, 2018 Florian Jung
+ *
+ * This file is part of factorio-bot.
+ *
+ * factorio-bot is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License,
+ * version 3, as published by the Free Software Foundation.
+ *
+ * factorio-bot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with factorio-bot. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Snapshots of the world model, see FactorioGame::save_snapshot().
+ *
+ * The file is a flat sequence of native-endian values, starting with a magic
+ * string, the format version and a byte order marker, so that stale or foreign
+ * snapshots are rejected instead of being misread. Prototypes are not saved
+ * (they are re-read from the start of the output file), but are referred to by
+ * their ids; a fingerprint of all prototype names makes sure that these ids
+ * still mean the same thing. The snapshot also records how far into the output
+ * file it is valid, plus a hash of the bytes right before that position, to
+ * detect an output file that has been replaced in the meantime.
+ */
+
+#include <fstream>
+#include <stdexcept>
+#include <cstring>
+#include <cstdio>
+#include <type_traits>
+#include <array>
+
+#include "factorio_io.h"
+#include "logging.hpp"
+
+using namespace std;
+
+static constexpr array<char,8> SNAPSHOT_MAGIC = {'F','B','O','T','S','N','A','P'};
+static constexpr uint32_t SNAPSHOT_VERSION = 2;
+static constexpr uint32_t SNAPSHOT_BYTE_ORDER = 0x01020304;
+static constexpr size_t SNAPSHOT_TAIL_LEN = 256; // this many bytes before the resume position are hashed
+
+static constexpr uint32_t NO_PROTOTYPE = UINT32_MAX;
+
+namespace {
+
+uint64_t fnv1a(string_view str, uint64_t hash = 0xcbf29ce484222325ull)
+{
+	for (unsigned char c : str)
+	{
+		hash ^= c;
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
+
+class SnapshotWriter
+{
+	public:
+		template <typename T> void put(const T& value)
+		{
+			static_assert(is_trivially_copyable<T>::value);
+			const char* bytes = reinterpret_cast<const char*>(&value);
+			buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+		}
+		void put_pos(const Pos& pos) { put<int32_t>(pos.x); put<int32_t>(pos.y); }
+		void put_pos(const Pos_f& pos) { put<double>(pos.x); put<double>(pos.y); }
+
+		vector<char> buffer;
+};
+
+class SnapshotReader
+{
+	public:
+		SnapshotReader(const vector<char>& buffer) : cur(buffer.data()), end(buffer.data() + buffer.size()) {}
+
+		template <typename T> T get()
+		{
+			static_assert(is_trivially_copyable<T>::value);
+			if (size_t(end - cur) < sizeof(T))
+				throw runtime_error("corrupt snapshot: unexpected end of file");
+			T value;
+			memcpy(&value, cur, sizeof(T));
+			cur += sizeof(T);
+			return value;
+		}
+		Pos get_pos() { int x = get<int32_t>(); int y = get<int32_t>(); return Pos(x,y); }
+		Pos_f get_pos_f() { double x = get<double>(); double y = get<double>(); return Pos_f(x,y); }
+		/** reads the number of elements of a list. Every element takes at least one byte. */
+		size_t get_count()
+		{
+			uint64_t n = get<uint64_t>();
+			if (n > uint64_t(end - cur))
+				throw runtime_error("corrupt snapshot: invalid count");
+			return n;
+		}
+
+		bool at_end() const { return cur == end; }
+
+	private:
+		const char* cur;
+		const char* end;
+};
+
+}
+
+/** identifies the set of prototypes, and thus the meaning of the ids the snapshot refers to */
+static uint64_t prototype_fingerprint(const PrototypeIndex<EntityPrototype>& entities, const PrototypeIndex<ItemPrototype>& items)
+{
+	uint64_t hash = fnv1a("entities");
+	for (size_t i=0; i<entities.size(); i++)
+		hash = fnv1a(entities[i]->name + '\n', hash);
+	hash = fnv1a("items", hash);
+	for (size_t i=0; i<items.size(); i++)
+		hash = fnv1a(items[i]->name + '\n', hash);
+	return hash;
+}
+
+static void put_entity(SnapshotWriter& out, const Entity& ent)
+{
+	if (ent.proto == nullptr)
+	{
+		out.put<uint32_t>(NO_PROTOTYPE);
+		return;
+	}
+
+	out.put<uint32_t>(ent.proto->id);
+	out.put_pos(ent.pos);
+	out.put<uint8_t>(ent.direction);
+
+	if (const ContainerData* data = ent.data_or_null<ContainerData>())
+	{
+		out.put<uint8_t>(data->fuel_is_output);
+		out.put<uint64_t>(distance(data->inventories.begin(), data->inventories.end()));
+		for (const auto& [key, amount] : data->inventories)
+		{
+			out.put<uint32_t>(key.item->id);
+			out.put<int32_t>(key.inv);
+			out.put<uint64_t>(amount);
+		}
+	}
+}
+
+static Entity get_entity(SnapshotReader& in, const PrototypeIndex<EntityPrototype>& entity_protos, const PrototypeIndex<ItemPrototype>& item_protos)
+{
+	uint32_t proto_id = in.get<uint32_t>();
+	if (proto_id == NO_PROTOTYPE)
+		return Entity(Entity::nullent_tag{});
+	if (proto_id >= entity_protos.size())
+		throw runtime_error("corrupt snapshot: invalid entity prototype id");
+
+	Pos_f pos = in.get_pos_f();
+	uint8_t dir = in.get<uint8_t>();
+	if (dir >= 4)
+		throw runtime_error("corrupt snapshot: invalid direction");
+
+	Entity ent(pos, entity_protos[proto_id], dir4_t(dir));
+
+	if (ContainerData* data = ent.data_or_null<ContainerData>())
+	{
+		data->fuel_is_output = in.get<uint8_t>();
+		size_t n_stacks = in.get_count();
+		for (size_t i=0; i<n_stacks; i++)
+		{
+			uint32_t item_id = in.get<uint32_t>();
+			if (item_id >= item_protos.size())
+				throw runtime_error("corrupt snapshot: invalid item prototype id");
+			inventory_t inv = inventory_t(in.get<int32_t>());
+			size_t amount = in.get<uint64_t>();
+			data->inventories.insert(inv, item_protos[item_id], amount);
+		}
+	}
+
+	return ent;
+}
+
+void FactorioGame::save_snapshot(const string& filename) const
+{
+	Logger log("core");
+
+	if (!entity_prototype_index.is_frozen())
+		throw logic_error("save_snapshot() called before STATIC_DATA_END");
+
+	SnapshotWriter out;
+
+	out.put(SNAPSHOT_MAGIC);
+	out.put<uint32_t>(SNAPSHOT_VERSION);
+	out.put<uint32_t>(SNAPSHOT_BYTE_ORDER);
+	out.put<uint64_t>(prototype_fingerprint(entity_prototype_index, item_prototype_index));
+
+	// where to resume reading
+	uint64_t tail_begin = committed_file_offset - min<uint64_t>(committed_file_offset, SNAPSHOT_TAIL_LEN);
+	string tail = factorio_file.read_at(tail_begin, committed_file_offset - tail_begin);
+	if (tail.size() != committed_file_offset - tail_begin)
+		throw runtime_error("save_snapshot(): the output file is shorter than what has been read from it");
+
+	out.put<int32_t>(factorio_file_id);
+	out.put<uint64_t>(committed_file_offset);
+	out.put<uint64_t>(fnv1a(tail));
+	out.put<int32_t>(last_tick);
+	out.put<int32_t>(next_free_resource_id);
+
+	out.put<uint64_t>(walk_map.n_chunks());
+	walk_map.for_each_chunk([&out](const Pos& chunkpos, const Chunk<pathfinding::walk_t>& chunk) {
+		out.put_pos(chunkpos);
+		for (const auto& column : chunk)
+			for (const pathfinding::walk_t& tile : column)
+			{
+				out.put<uint8_t>(tile.known | tile.can_walk << 1 | tile.can_cross << 2);
+				out.put<int32_t>(tile.tree_amount);
+				for (const auto& margin : tile.margins)
+					out.put<uint16_t>(margin.raw());
+			}
+	});
+
+	out.put<uint64_t>(resource_map.n_chunks());
+	resource_map.for_each_chunk([&out](const Pos& chunkpos, const Chunk<Resource>& chunk) {
+		out.put_pos(chunkpos);
+		for (const auto& column : chunk)
+			for (const Resource& tile : column)
+			{
+				out.put<uint8_t>(tile.type);
+				out.put<int32_t>(tile.patch_id);
+				if (tile.type != Resource::NONE)
+					put_entity(out, tile.entity);
+			}
+	});
+
+	out.put<uint64_t>(resource_patches.size());
+	for (const auto& patch : resource_patches)
+	{
+		out.put<uint8_t>(patch->type);
+		out.put<int32_t>(patch->patch_id);
+		out.put<uint64_t>(patch->positions.size());
+		for (const Pos& pos : patch->positions)
+			out.put_pos(pos);
+	}
+
+	out.put<uint64_t>(actual_entities.size());
+	for (const auto& [chunkpos, entities] : actual_entities)
+	{
+		out.put_pos(chunkpos);
+		out.put<uint64_t>(entities.size());
+		for (const Entity& ent : entities)
+			put_entity(out, ent);
+	}
+
+	out.put<uint64_t>(players.size());
+	for (const Player& player : players)
+	{
+		out.put<uint64_t>(player.id);
+		out.put_pos(player.position);
+		out.put<uint8_t>(player.connected);
+		out.put<uint64_t>(player.inventory.size());
+		for (const auto& [item, content] : player.inventory)
+		{
+			out.put<uint32_t>(item->id);
+			out.put<uint64_t>(content.amount);
+		}
+	}
+
+	// write to a temporary file first, so that a crash never leaves a truncated snapshot behind
+	string tmpname = filename + ".tmp";
+	{
+		ofstream f(tmpname, ios::binary | ios::trunc);
+		f.write(out.buffer.data(), out.buffer.size());
+		if (!f)
+			throw runtime_error("could not write snapshot to '"+tmpname+"'");
+	}
+	if (rename(tmpname.c_str(), filename.c_str()) != 0)
+		throw runtime_error("could not rename '"+tmpname+"' to '"+filename+"'");
+
+	log << "wrote snapshot of tick " << last_tick << " (" << out.buffer.size() << " bytes) to '" << filename << "'" << endl;
+}
+
+bool FactorioGame::load_snapshot(const string& filename)
+{
+	Logger log("core");
+
+	if (!entity_prototype_index.is_frozen())
+		throw logic_error("load_snapshot() called before STATIC_DATA_END");
+
+	vector<char> buffer;
+	{
+		ifstream f(filename, ios::binary | ios::ate);
+		if (!f)
+		{
+			log << "no snapshot found at '" << filename << "'" << endl;
+			return false;
+		}
+		buffer.resize(f.tellg());
+		f.seekg(0);
+		f.read(buffer.data(), buffer.size());
+		if (!f)
+			throw runtime_error("could not read snapshot '"+filename+"'");
+	}
+
+	SnapshotReader in(buffer);
+
+	if (buffer.size() < sizeof(SNAPSHOT_MAGIC) || in.get< array<char,8> >() != SNAPSHOT_MAGIC)
+		throw runtime_error("'"+filename+"' is not a snapshot");
+
+	if (in.get<uint32_t>() != SNAPSHOT_VERSION || in.get<uint32_t>() != SNAPSHOT_BYTE_ORDER)
+	{
+		log << "ignoring snapshot '" << filename << "' from a different version or machine" << endl;
+		return false;
+	}
+	if (in.get<uint64_t>() != prototype_fingerprint(entity_prototype_index, item_prototype_index))
+	{
+		log << "ignoring snapshot '" << filename << "', because the prototypes have changed" << endl;
+		return false;
+	}
+
+	int file_id = in.get<int32_t>();
+	uint64_t file_offset = in.get<uint64_t>();
+	uint64_t tail_hash = in.get<uint64_t>();
+	uint64_t tail_begin = file_offset - min<uint64_t>(file_offset, SNAPSHOT_TAIL_LEN);
+	if (file_id != factorio_file_id || file_offset < read_position() ||
+		fnv1a(factorio_file.read_at(tail_begin, file_offset - tail_begin)) != tail_hash)
+	{
+		log << "ignoring snapshot '" << filename << "', because it does not belong to the current output file" << endl;
+		return false;
+	}
+
+	// everything is read into temporaries first, so that a corrupt snapshot does not leave us in a half-restored state
+	int tick = in.get<int32_t>();
+	int free_resource_id = in.get<int32_t>();
+
+	WorldMap<pathfinding::walk_t> new_walk_map;
+	size_t n_chunks = in.get_count();
+	for (size_t i=0; i<n_chunks; i++)
+	{
+		Pos chunkpos = in.get_pos();
+		for (auto& column : *new_walk_map.get_chunk(chunkpos.x, chunkpos.y))
+			for (pathfinding::walk_t& tile : column)
+			{
+				uint8_t flags = in.get<uint8_t>();
+				tile.known = flags & 1;
+				tile.can_walk = flags & 2;
+				tile.can_cross = flags & 4;
+				tile.tree_amount = in.get<int32_t>();
+				for (auto& margin : tile.margins)
+					margin = pathfinding::margin_t::from_raw(in.get<uint16_t>());
+			}
+	}
+
+	WorldMap<Resource> new_resource_map;
+	n_chunks = in.get_count();
+	for (size_t i=0; i<n_chunks; i++)
+	{
+		Pos chunkpos = in.get_pos();
+		for (auto& column : *new_resource_map.get_chunk(chunkpos.x, chunkpos.y))
+			for (Resource& tile : column)
+			{
+				uint8_t type = in.get<uint8_t>();
+				if (type >= Resource::N_RESOURCES)
+					throw runtime_error("corrupt snapshot: invalid resource type");
+				tile.type = Resource::type_t(type);
+				tile.patch_id = in.get<int32_t>();
+				if (tile.type != Resource::NONE)
+					tile.entity = get_entity(in, entity_prototype_index, item_prototype_index);
+			}
+	}
+
+	set< shared_ptr<ResourcePatch> > new_resource_patches;
+	unordered_map< int, shared_ptr<ResourcePatch> > patches_by_id;
+	size_t n_patches = in.get_count();
+	for (size_t i=0; i<n_patches; i++)
+	{
+		uint8_t type = in.get<uint8_t>();
+		if (type >= Resource::N_RESOURCES)
+			throw runtime_error("corrupt snapshot: invalid resource type");
+		int patch_id = in.get<int32_t>();
+		vector<Pos> positions(in.get_count());
+		for (Pos& pos : positions)
+			pos = in.get_pos();
+
+		auto patch = make_shared<ResourcePatch>(positions, Resource::type_t(type), patch_id);
+		new_resource_patches.insert(patch);
+		patches_by_id[patch_id] = patch;
+	}
+	for (const auto& [_, patch] : patches_by_id)
+		for (const Pos& pos : patch->positions)
+			new_resource_map.at(pos).resource_patch = patch;
+
+	WorldList<Entity, Entity::mostly_equals_comparator, Entity::mostly_equals_hash> new_actual_entities;
+	n_chunks = in.get_count();
+	for (size_t i=0; i<n_chunks; i++)
+	{
+		vector<Entity>& entities = new_actual_entities[in.get_pos()];
+		size_t n_entities = in.get_count();
+		entities.reserve(n_entities);
+		for (size_t j=0; j<n_entities; j++)
+			entities.push_back(get_entity(in, entity_prototype_index, item_prototype_index));
+	}
+
+	vector<Player> new_players(in.get_count());
+	for (Player& player : new_players)
+	{
+		player.id = in.get<uint64_t>();
+		player.position = in.get_pos_f();
+		player.connected = in.get<uint8_t>();
+		size_t n_items = in.get_count();
+		for (size_t i=0; i<n_items; i++)
+		{
+			uint32_t item_id = in.get<uint32_t>();
+			if (item_id >= item_prototype_index.size())
+				throw runtime_error("corrupt snapshot: invalid item prototype id");
+			player.inventory[item_prototype_index[item_id]].amount = in.get<uint64_t>();
+		}
+	}
+
+	if (!in.at_end())
+		throw runtime_error("corrupt snapshot: trailing garbage");
+
+	if (!factorio_file.open(factorio_file_name(), file_offset))
+		throw runtime_error("could not seek to the snapshot's position in the output file");
+
+	last_tick = tick;
+	next_free_resource_id = free_resource_id;
+	committed_file_offset = file_offset;
+	walk_map = move(new_walk_map);
+	pathfinder.clear();
+	resource_map = move(new_resource_map);
+	resource_patches = move(new_resource_patches);
+	actual_entities = move(new_actual_entities);
+	players = move(new_players);
+
+	log << "resumed from snapshot '" << filename << "' at tick " << last_tick << endl;
+	return true;
+}
@@ -16,56 +16,156 @@
  * along with factorio-bot. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#pragma once
+
 #include <string>
+#include <string_view>
 #include <vector>
-#include <sstream>
+#include <array>
 #include <tuple>
+#include <charconv>
+#include <stdexcept>
+#include <iterator>
 
-// TODO FIXME: iterable thingy
-
-static std::vector<std::string> split(const std::string& data, char delim=' ')
+/** Iterates over the fields of `data` that are separated by `delim`, without copying
+  * or allocating anything. The fields are string_views into `data`.
+  *
+  * Yields the same fields as split() does: an empty string yields no fields at all,
+  * while "a,,b," yields "a", "", "b" and "".
+  *
+  * Usage: for (std::string_view field : split_view(data, ',')) ...
+  */
+class split_view
 {
-	std::istringstream str(data);
-	std::string entry;
-	std::vector<std::string> result;
+	public:
+		class iterator
+		{
+			public:
+				using iterator_category = std::forward_iterator_tag;
+				using value_type = std::string_view;
+				using difference_type = std::ptrdiff_t;
+				using pointer = const std::string_view*;
+				using reference = const std::string_view&;
 
-	if (data.empty())
-		return result;
+				iterator() {}
+
+				reference operator*() const { return field; }
+				pointer operator->() const { return &field; }
+
+				iterator& operator++()
+				{
+					advance();
+					return *this;
+				}
+				iterator operator++(int)
+				{
+					iterator tmp = *this;
+					advance();
+					return tmp;
+				}
+
+				bool operator==(const iterator& other) const
+				{
+					return at_end == other.at_end && (at_end || field.data() == other.field.data());
+				}
+				bool operator!=(const iterator& other) const { return !(*this == other); }
+
+			private:
+				friend class split_view;
+
+				iterator(std::string_view data, char delim_) : rest(data), delim(delim_), at_end(data.empty())
+				{
+					if (!at_end)
+						advance();
+				}
+
+				void advance()
+				{
+					if (last)
+					{
+						at_end = true;
+						return;
+					}
+
+					auto pos = rest.find(delim);
+					field = rest.substr(0, pos);
+					if (pos == std::string_view::npos)
+						last = true;
+					else
+						rest.remove_prefix(pos+1);
+				}
+
+				std::string_view rest;
+				std::string_view field;
+				char delim = ' ';
+				bool last = false; // field is the last one
+				bool at_end = true; // we're past the last field
+		};
 
-	do {
-		getline(str, entry, delim);
-		result.push_back(std::move(entry));
-	} while (!str.eof());
-	
+		split_view(std::string_view data_, char delim_=' ') : data(data_), delim(delim_) {}
+
+		iterator begin() const { return iterator(data, delim); }
+		iterator end() const { return iterator(); }
+
+	private:
+		std::string_view data;
+		char delim;
+};
+
+inline std::vector<std::string> split(std::string_view data, char delim=' ')
+{
+	std::vector<std::string> result;
+	for (std::string_view field : split_view(data, delim))
+		result.emplace_back(field);
 	return result;
 }
 
-template <typename T> T convert(std::string const& s)
+/** converts the string `s` to T. Numbers are converted with std::from_chars and must
+  * span the whole string; std::string_view returns `s` itself, without copying. */
+template <typename T> T convert(std::string_view s)
 {
-	if constexpr (std::is_integral_v<T>)
-		return T(stoi(s));
-	else if constexpr (std::is_floating_point_v<T>)
-		return T(stod(s));
-	else if constexpr (std::is_same_v<T, std::string>)
+	if constexpr (std::is_same_v<T, bool>)
+		return convert<int>(s) != 0;
+	else if constexpr (std::is_arithmetic_v<T>)
+	{
+		T result;
+		auto [ptr, err] = std::from_chars(s.data(), s.data()+s.size(), result);
+		if (err != std::errc() || ptr != s.data()+s.size())
+			throw std::runtime_error("malformed number '"+std::string(s)+"'");
+		return result;
+	}
+	else if constexpr (std::is_same_v<T, std::string_view>)
 		return s;
+	else if constexpr (std::is_same_v<T, std::string>)
+		return std::string(s);
 	else
 		return T(s);
 }
 
 template <typename... Ts, std::size_t... Is>
-	std::tuple<Ts...> unpack(std::vector<std::string> const& v, std::index_sequence<Is...>)
+	std::tuple<Ts...> unpack(const std::array<std::string_view, sizeof...(Ts)>& fields, std::index_sequence<Is...>)
 {
-	return {convert<Ts>(v[Is])...};
+	return {convert<Ts>(fields[Is])...};
 }
 
-template <typename... Ts> std::tuple<Ts...> unpack(std::vector<std::string> const& v)
+/** splits `str` at `delim` and converts the first sizeof...(Ts) fields to Ts.
+  * Surplus fields are ignored; missing fields are an error. Does not allocate
+  * unless one of the Ts is a std::string. */
+template <typename... Ts> std::tuple<Ts...> unpack(std::string_view str, char delim=' ')
 {
-	return unpack<Ts...>(v, std::index_sequence_for<Ts...>{});
-}
+	std::array<std::string_view, sizeof...(Ts)> fields;
+	size_t n = 0;
+	for (std::string_view field : split_view(str, delim))
+	{
+		if (n == fields.size())
+			break;
+		fields[n++] = field;
+	}
 
-template <typename... Ts> std::tuple<Ts...> unpack(const std::string& str, char delim=' ')
-{
-	return unpack<Ts...>(split(str, delim));
+	if (n != fields.size())
+		throw std::runtime_error("malformed entry '"+std::string(str)+"': expected "+std::to_string(fields.size())+" fields, got "+std::to_string(n));
+
+	return unpack<Ts...>(fields, std::index_sequence_for<Ts...>{});
 }
 
-// Usage: auto [foo, bar, baz] = unpack<int, float, string>(my_vector)
+// Usage: auto [foo, bar, baz] = unpack<int, float, string_view>(my_string, ',')
@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2017, 2018 Florian Jung
+ *
+ * This file is part of factorio-bot.
+ *
+ * factorio-bot is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License,
+ * version 3, as published by the Free Software Foundation.
+ *
+ * factorio-bot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with factorio-bot. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../pathfinder.hpp"
+#include "../worldmap.hpp"
+
+#include <iostream>
+#include <cstdlib>
+#include <vector>
+
+using namespace std;
+using namespace pathfinding;
+
+static void dump_path(const string& what, const vector<Pos>& path)
+{
+	// how far the path strays from the line between start and goal
+	int farthest = 0;
+	for (const Pos& pos : path)
+		if (abs(pos.y) > abs(farthest))
+			farthest = pos.y;
+	cout << what << ": " << path.size() << " waypoints, reaching y=" << farthest << endl;
+}
+
+static void dump_stats(const Pathfinder& pathfinder)
+{
+	PathCache::stats_t stats = pathfinder.cache_stats();
+	cout << "cache: " << stats.hits << " hits, " << stats.misses << " misses, " << stats.outdated << " outdated" << endl;
+}
+
+static void build_wall(WorldMap<walk_t>& map, Pathfinder& pathfinder, int x, int y1, int y2, bool remove = false)
+{
+	for (int y = y1; y <= y2; y++)
+		map.at(x,y).can_walk = remove;
+	pathfinder.invalidate(Area(x, y1, x+1, y2+1));
+}
+
+int main()
+{
+	walk_t walkable;
+	walkable.known = true;
+	walkable.can_walk = true;
+	walkable.can_cross = true;
+
+	WorldMap<walk_t> map;
+	for (int x = -100; x < 200; x++)
+		for (int y = -150; y < 150; y++)
+			map.at(x,y) = walkable;
+
+	Pathfinder pathfinder(map);
+	const Pos start(0,0);
+	const Area_f goal(Pos_f(100.,0.), Pos_f(100.,0.));
+
+	// the detour around the wall leaves the strip between start and goal by about 40 tiles
+	build_wall(map, pathfinder, 50, -40, 40);
+	dump_path("around the wall", pathfinder.find_path(start, goal));
+	dump_path("again", pathfinder.find_path(start, goal));
+	dump_stats(pathfinder);
+
+	// lengthening the wall blocks the cached path, so it must not be returned again
+	build_wall(map, pathfinder, 50, -50, -41);
+	dump_path("around the longer wall", pathfinder.find_path(start, goal));
+	dump_stats(pathfinder);
+
+	// changes far away from every path of that length leave the entry alone
+	build_wall(map, pathfinder, 50, 100, 120);
+	dump_path("after a change far away", pathfinder.find_path(start, goal));
+	dump_stats(pathfinder);
+
+	// likewise, a gap in the wall that allows a path within the length limit must be noticed,
+	// even if no path was found before
+	dump_path("shorter than 125", pathfinder.find_path(start, goal, 2., 0., 125.));
+	dump_path("again", pathfinder.find_path(start, goal, 2., 0., 125.));
+	build_wall(map, pathfinder, 50, 34, 38, true);
+	dump_path("shorter than 125, through a gap", pathfinder.find_path(start, goal, 2., 0., 125.));
+	dump_stats(pathfinder);
+}
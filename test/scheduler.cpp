@@ -313,7 +313,7 @@ int main()
 	walkable.known=true;
 	walkable.can_walk=true;
 	walkable.can_cross=true;
-	for (double& w : walkable.margins) w=1.;
+	for (auto& w : walkable.margins) w=1.;
 
 	for (int x=-1000; x<1000; x++)
 		for (int y=-1000; y<1000; y++)
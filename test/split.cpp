@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2017, 2018 Florian Jung
+ *
+ * This file is part of factorio-bot.
+ *
+ * factorio-bot is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License,
+ * version 3, as published by the Free Software Foundation.
+ *
+ * factorio-bot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with factorio-bot. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../split.hpp"
+#include "../area.hpp"
+
+#include <iostream>
+#include <string>
+#include <string_view>
+
+using namespace std;
+
+static void dump_fields(string_view data, char delim)
+{
+	cout << "'" << data << "' split at '" << delim << "':";
+	for (string_view field : split_view(data, delim))
+		cout << " [" << field << "]";
+	cout << endl;
+
+	if (split(data, delim).size() != size_t(distance(split_view(data, delim).begin(), split_view(data, delim).end())))
+		cout << "\tMISMATCH between split() and split_view()" << endl;
+}
+
+int main()
+{
+	dump_fields("", ',');
+	dump_fields(",", ',');
+	dump_fields("foo", ',');
+	dump_fields("foo,bar", ',');
+	dump_fields(",foo,,bar,", ',');
+	dump_fields("tree-01 12.5 -3.25 N", ' ');
+
+	auto [name, x, y, dir] = unpack<string_view, double, double, string_view>("tree-01 12.5 -3.25 N");
+	cout << "unpacked: " << name << " / " << x << " / " << y << " / " << dir << endl;
+
+	auto [item, amount] = unpack<string, size_t>("iron-plate:42", ':');
+	cout << "unpacked: " << item << " / " << amount << endl;
+
+	auto [id, ignored_rest] = unpack<int, string_view>("7 surplus fields are ignored");
+	cout << "unpacked: " << id << " / " << ignored_rest << endl;
+
+	Area area("-32,64;0,96");
+	cout << "area: " << area.str() << endl;
+	Area_f box("-0.4,-0.5;0.4,0.5");
+	cout << "box: " << box.str() << endl;
+
+	for (string_view malformed : {"1 2", "1 x 3", "1 2.5 3"})
+	{
+		try
+		{
+			auto [a,b,c] = unpack<int,int,int>(malformed);
+			cout << "'" << malformed << "' unpacked to " << a << "," << b << "," << c << endl;
+		}
+		catch (const runtime_error& e)
+		{
+			cout << "'" << malformed << "' throws: " << e.what() << endl;
+		}
+	}
+}
@@ -58,12 +58,14 @@
 using namespace std;
 
 typedef WorldList<Entity> WL;
+typedef WorldList<Entity, Entity::mostly_equals_comparator, Entity::mostly_equals_hash> IndexedWL;
 
 
 static void show(const WL& l);
 static void test_erase(WL l, size_t i);
 static void test_around(WL l, Pos_f center);
 static void test_around_erase(WL l, Pos_f center, size_t idx);
+static void test_search(size_t i, bool by_value);
 static WL makeWL();
 
 static void show(const WL& l)
@@ -126,6 +128,36 @@ static void test_around_erase(WL l, Pos_f center, size_t idx)
 
 static EntityPrototype ent_proto("","","",{},true,{});
 
+static void test_search(size_t i, bool by_value)
+{
+	cout << "searching after erasing element #" << i << (by_value ? " by value" : "") << " from an indexed list:";
+
+	WL all = makeWL();
+	IndexedWL l;
+	for (const auto& x : all.within_range( Area_f(-100,-100,200,200) ))
+		l.insert(x);
+	for (const auto& x : all.within_range( Area_f(-100,-100,200,200) ))
+		l.search(x); // builds the index
+
+	IndexedWL::WithinRange r = l.within_range( Area_f(0,0,100,100) );
+	auto it = r.begin();
+	for (size_t j=0; j<i; j++) it++;
+	Entity erased = *it;
+	if (by_value)
+		l.erase(erased);
+	else
+		l.erase(it);
+	l.insert(Entity(Pos_f(2.5,5.7), &ent_proto));
+
+	for (const auto& x : all.within_range( Area_f(-100,-100,200,200) ))
+	{
+		bool found = l.search_or_null(x) != nullptr;
+		if (found == x.mostly_equals(erased))
+			cout << " WRONG(" << x.pos.str() << ")";
+	}
+	cout << (l.search_or_null(Entity(Pos_f(2.5,5.7), &ent_proto)) ? " ok" : " WRONG(new)") << endl;
+}
+
 static WL makeWL()
 {
 	WL l;
@@ -163,4 +195,9 @@ int main()
 	test_around(makeWL(), Pos_f(0.,-9999.));
 
 	test_around_erase(makeWL(), Pos_f(0.,0.), 2);
+
+	for (size_t i=0; i<11; i++)
+		test_search(i, false);
+	for (size_t i=0; i<11; i++)
+		test_search(i, true);
 }
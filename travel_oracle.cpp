@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2017, 2018 Florian Jung
+ *
+ * This file is part of factorio-bot.
+ *
+ * factorio-bot is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License,
+ * version 3, as published by the Free Software Foundation.
+ *
+ * factorio-bot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with factorio-bot. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <cassert>
+
+#include "travel_oracle.hpp"
+
+using namespace std;
+using namespace pathfinding;
+
+TravelOracle::search_t& TravelOracle::search(const WorldMap<walk_t>& map, const PortalGraph& portals, const Pos& start)
+{
+	auto it = searches.find(start);
+	if (it != searches.end())
+		return it->second;
+
+	if (searches.size() >= MAX_SOURCES)
+		searches.clear();
+
+	search_t& result = searches[start];
+	Pos start_chunk = Pos::chunk_to_tile(Pos::tile_to_chunk(start));
+	result.start_graph = make_unique<LocalGraph>(map, Area(start_chunk, start_chunk + Pos(32,32)), PortalGraph::SIZE);
+	result.from_start = result.start_graph->distances({{start, 0.f}}, false);
+	result.chunks.insert(Pos::tile_to_chunk(start));
+
+	for (const PortalGraph::node_t& node : portals.cluster(map, Pos::tile_to_chunk(start)).nodes)
+	{
+		float dist = result.from_start[result.start_graph->index(node.pos)];
+		if (dist < numeric_limits<float>::infinity())
+		{
+			result.g_vals[node.pos] = dist;
+			result.openlist.push(Entry(node.pos, dist));
+		}
+	}
+	return result;
+}
+
+double TravelOracle::distance(const WorldMap<walk_t>& map, const PortalGraph& portals, const Pos& start, const Area_f& end, double allowed_distance)
+{
+	double direct = max(0., ::distance(start, end) - allowed_distance);
+	if (allowed_distance > MAX_ALLOWED_DISTANCE)
+		return direct;
+
+	lock_guard<mutex> lock(searches_mutex);
+	search_t& s = search(map, portals, start);
+
+	auto estimate = [&](const Pos& pos, double g_val) {
+		return g_val + max(0., ::distance(pos, end) - allowed_distance);
+	};
+
+	Area goal_box = pathfinding::goal_box(end, allowed_distance);
+	Area goal_chunks(Pos::tile_to_chunk(goal_box.left_top), Pos::tile_to_chunk_ceil(goal_box.right_bottom));
+	double best = numeric_limits<double>::infinity();
+
+	// goals close to the start may be reached without ever crossing a portal
+	Area local = goal_box.intersect(s.start_graph->area);
+	for (int x = local.left_top.x; x < local.right_bottom.x; x++)
+		for (int y = local.left_top.y; y < local.right_bottom.y; y++)
+		{
+			float dist = s.from_start[s.start_graph->index(Pos(x,y))];
+			if (dist < numeric_limits<float>::infinity())
+				best = min(best, estimate(Pos(x,y), dist));
+		}
+
+	// any other path enters one of the goal's chunks at one of its nodes
+	for (int x = goal_chunks.left_top.x; x < goal_chunks.right_bottom.x; x++)
+		for (int y = goal_chunks.left_top.y; y < goal_chunks.right_bottom.y; y++)
+			for (const PortalGraph::node_t& node : portals.cluster(map, Pos(x,y)).nodes)
+			{
+				auto it = s.g_vals.find(node.pos);
+				if (it != s.g_vals.end())
+					best = min(best, estimate(node.pos, it->second));
+			}
+
+	// continue the search until no node that is still open can improve the estimate
+	double limit = max(direct * MAX_DETOUR_FACTOR, direct + MAX_DETOUR);
+	while (!s.openlist.empty())
+	{
+		Entry current = s.openlist.top();
+		if (current.f >= best || current.f > limit)
+			break;
+		s.openlist.pop();
+		if (current.f > s.g_vals.at(current.pos))
+			continue; // outdated entry
+
+		const PortalGraph::node_t* node = portals.cluster(map, Pos::tile_to_chunk(current.pos)).find(current.pos);
+		assert(node != nullptr);
+		for (const PortalGraph::edge_t& edge : node->edges)
+		{
+			double g_val = current.f + edge.cost;
+			auto [it, inserted] = s.g_vals.try_emplace(edge.to, g_val);
+			if (inserted)
+				s.chunks.insert(Pos::tile_to_chunk(edge.to));
+			else
+			{
+				if (it->second <= g_val)
+					continue;
+				it->second = g_val;
+			}
+			s.openlist.push(Entry(edge.to, g_val));
+
+			if (goal_chunks.contains(Pos::tile_to_chunk(edge.to)))
+				best = min(best, estimate(edge.to, g_val));
+		}
+	}
+
+	if (best == numeric_limits<double>::infinity() && !s.openlist.empty())
+		return max(direct, s.openlist.top().f); // we gave up
+	return max(direct, best);
+}
+
+void TravelOracle::invalidate(const Area& area)
+{
+	// like the clusters of the PortalGraph, which depend on the tiles next to their chunk
+	Area changed(Pos::tile_to_chunk(area.left_top - Pos(2,2)), Pos::tile_to_chunk_ceil(area.right_bottom + Pos(3,3)));
+
+	lock_guard<mutex> lock(searches_mutex);
+	for (auto it = searches.begin(); it != searches.end();)
+	{
+		const unordered_set<Pos>& chunks = it->second.chunks;
+		if (any_of(chunks.begin(), chunks.end(), [&](const Pos& chunk) { return changed.contains(chunk); }))
+			it = searches.erase(it);
+		else
+			++it;
+	}
+}
+
+void TravelOracle::clear()
+{
+	lock_guard<mutex> lock(searches_mutex);
+	searches.clear();
+}
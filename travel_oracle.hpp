@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2017, 2018 Florian Jung
+ *
+ * This file is part of factorio-bot.
+ *
+ * factorio-bot is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License,
+ * version 3, as published by the Free Software Foundation.
+ *
+ * factorio-bot is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with factorio-bot. If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "portal_graph.hpp"
+#include "dary_heap.hpp"
+#include "worldmap.hpp"
+#include "pos.hpp"
+#include "area.hpp"
+
+namespace pathfinding
+{
+	/** Estimates walking distances for planning, e.g. how long the walk between two tasks takes.
+	  *
+	  * For each start position, a Dijkstra search over the PortalGraph is run lazily, and only as far
+	  * as the queries so far needed. A goal is then estimated by the best node of the chunks around
+	  * it, plus the direct line from that node to the goal. Goals in the start's own chunk also use
+	  * the exact distances within that chunk. The result is never shorter than the direct line.
+	  * It may be a bit longer than the real distance because of the detours that HPA* makes (see
+	  * Pathfinder), or a bit shorter because the way from the last node to the goal is guessed.
+	  *
+	  * Queries from the same start are answered from the settled nodes in O(nodes per chunk), so a
+	  * planner can ask thousands of them. A search is kept until the map changes in a chunk whose
+	  * PortalGraph cluster it has read, which includes the chunks of all nodes it has reached.
+	  */
+	class TravelOracle
+	{
+		public:
+			/** goals whose allowed_distance is larger than this only use the direct line */
+			static constexpr double MAX_ALLOWED_DISTANCE = 64.;
+			/** the search gives up at this multiple of the direct line... */
+			static constexpr double MAX_DETOUR_FACTOR = 3.;
+			/** ...or this much longer than it, whichever is more */
+			static constexpr double MAX_DETOUR = 256.;
+			/** all searches are forgotten when there are more than this many start positions */
+			static constexpr size_t MAX_SOURCES = 64;
+
+			/** returns the estimated length of the shortest path from `start` to any position
+			  * within `allowed_distance` of `end`, or infinity if there is none. If the search
+			  * gives up, the estimate is the length up to which it has looked. */
+			double distance(const WorldMap<walk_t>& map, const PortalGraph& portals, const Pos& start, const Area_f& end, double allowed_distance);
+
+			/** forgets the searches that depend on the tiles in `area` */
+			void invalidate(const Area& area);
+			/** forgets all searches, e.g. because the whole walk map was replaced */
+			void clear();
+
+		private:
+			struct search_t
+			{
+				std::unique_ptr<LocalGraph> start_graph;
+				std::vector<float> from_start; // exact distances within the start's chunk
+				std::unordered_map<Pos, double> g_vals; // of the nodes reached so far
+				DaryHeap<Entry> openlist;
+				std::unordered_set<Pos> chunks; // of the start and of every node in g_vals, in chunk coordinates
+			};
+
+			std::mutex searches_mutex;
+			std::unordered_map<Pos, search_t> searches;
+
+			search_t& search(const WorldMap<walk_t>& map, const PortalGraph& portals, const Pos& start);
+	};
+}
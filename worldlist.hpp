@@ -59,13 +59,159 @@
 #include <stdexcept>
 #include <unordered_map>
 #include <algorithm>
+#include <cstdint>
 
 #include "pos.hpp"
 #include "area.hpp"
 
-template <class T, class EqualComparator = std::equal_to<T>>
-class WorldList : public std::unordered_map< Pos, std::vector<T> >
+/** The things within one chunk of a WorldList with an `IndexKey`, together with a hash table
+  * from that key to their position in the vector. The table is kept up to date by WorldList's
+  * insert() and erase(). Code that modifies the vector directly is noticed by its size, and the
+  * table is rebuilt; it must not replace things without changing the size.
+  */
+template <class T, class IndexKey> class IndexedChunk : public std::vector<T>
 {
+	public:
+		/** returns the thing that equals `what`, or nullptr */
+		template <class EqualComparator> T* find(const T& what)
+		{
+			if (!is_current(0))
+				rebuild();
+
+			EqualComparator comp;
+			uint32_t key = key_of(what);
+			for (size_t slot = key & mask();; slot = (slot+1) & mask())
+			{
+				const slot_t& s = slots[slot];
+				if (s.position == EMPTY)
+					return nullptr;
+				if (s.key == key && comp((*this)[s.position], what))
+					return &(*this)[s.position];
+			}
+		}
+
+		/** updates the index after a thing was appended */
+		void appended()
+		{
+			if (is_current(1))
+			{
+				if (2*this->size() > slots.size())
+					valid = false; // too full, rebuild it with more slots
+				else
+				{
+					add(key_of(this->back()), this->size()-1);
+					n_indexed++;
+				}
+			}
+		}
+
+		/** updates the index before the i-th thing is replaced by the last one, which is then popped */
+		void erasing(size_t i)
+		{
+			if (is_current(0))
+			{
+				size_t last = this->size()-1;
+				remove(key_of((*this)[i]), i);
+				if (i != last)
+				{
+					uint32_t key = key_of(this->back());
+					remove(key, last);
+					add(key, i);
+				}
+				n_indexed--;
+			}
+		}
+
+		/** marks the index as outdated, e.g. because things have been moved */
+		void invalidate() { valid = false; }
+
+	private:
+		static constexpr uint32_t EMPTY = UINT32_MAX;
+		struct slot_t
+		{
+			uint32_t key;
+			uint32_t position = EMPTY; // in the vector
+		};
+
+		bool valid = false;
+		size_t n_indexed = 0; // the size of the vector when the index was last updated
+		// open addressing with linear probing, at most half full
+		std::vector<slot_t> slots;
+
+		size_t mask() const { return slots.size()-1; }
+
+		/** IndexKey's hashes may be bad in the lower bits, which select the slot, so mix them */
+		static uint32_t key_of(const T& thing)
+		{
+			return uint32_t((uint64_t(IndexKey()(thing)) * 0x9E3779B97F4A7C15ull) >> 32);
+		}
+
+		bool is_current(size_t n_added)
+		{
+			if (valid && n_indexed + n_added != this->size())
+				valid = false;
+			return valid;
+		}
+
+		void rebuild()
+		{
+			size_t n_slots = 8;
+			while (n_slots < 2*this->size())
+				n_slots *= 2;
+			slots.assign(n_slots, slot_t());
+			for (size_t i = 0; i < this->size(); i++)
+				add(key_of((*this)[i]), i);
+			n_indexed = this->size();
+			valid = true;
+		}
+
+		void add(uint32_t key, size_t i)
+		{
+			size_t slot = key & mask();
+			while (slots[slot].position != EMPTY)
+				slot = (slot+1) & mask();
+			slots[slot] = slot_t{key, uint32_t(i)};
+		}
+
+		void remove(uint32_t key, size_t i)
+		{
+			size_t slot = key & mask();
+			while (slots[slot].position != i)
+			{
+				if (slots[slot].position == EMPTY)
+					return;
+				slot = (slot+1) & mask();
+			}
+
+			// move later entries of the same probe sequence back into the gap
+			size_t gap = slot;
+			for (size_t next = (gap+1) & mask(); slots[next].position != EMPTY; next = (next+1) & mask())
+			{
+				size_t home = slots[next].key & mask();
+				// can the entry at `next` move to `gap`, i.e. is `home` not within (gap, next]?
+				if (((next - home) & mask()) >= ((next - gap) & mask()))
+				{
+					slots[gap] = slots[next];
+					gap = next;
+				}
+			}
+			slots[gap] = slot_t();
+		}
+};
+
+template <class T, class IndexKey> using WorldListChunk = std::conditional_t<std::is_void_v<IndexKey>, std::vector<T>, IndexedChunk<T, IndexKey>>;
+
+/** Stores things by the chunk that contains their position.
+  *
+  * If `IndexKey` is given, it must hash everything that `EqualComparator` compares. Every chunk
+  * is then an IndexedChunk, so that search() does not need to compare against every thing in
+  * the chunk.
+  */
+template <class T, class EqualComparator = std::equal_to<T>, class IndexKey = void>
+class WorldList : public std::unordered_map< Pos, WorldListChunk<T,IndexKey> >
+{
+	static constexpr bool INDEXED = !std::is_void_v<IndexKey>;
+
 	public:
 		/** returns an upper bound of the radius of the circle around center that contains the whole map */
 		double radius(Pos_f center = Pos_f(0.,0.)) const
@@ -91,8 +237,8 @@ class WorldList : public std::unordered_map< Pos, std::vector<T> >
 			private:
 				typedef typename std::conditional<is_const, const T&, T&>::type reftype;
 				typedef typename std::conditional<is_const, const T*, T*>::type ptrtype;
-				typedef std::unordered_map<Pos, std::vector<T>> maptype;
-				typedef typename std::conditional<is_const, const WorldList<T,EqualComparator>*, WorldList<T,EqualComparator>*>::type parentptr;
+				typedef std::unordered_map<Pos, WorldListChunk<T,IndexKey>> maptype;
+				typedef typename std::conditional<is_const, const WorldList<T,EqualComparator,IndexKey>*, WorldList<T,EqualComparator,IndexKey>*>::type parentptr;
 				parentptr parent;
 				Area_f range;
 
@@ -108,8 +254,8 @@ class WorldList : public std::unordered_map< Pos, std::vector<T> >
 					std::vector<T>*>::type
 					vec_t;
 				typedef typename std::conditional<is_const,
-					typename std::unordered_map< Pos, std::vector<T> >::const_iterator,
-					typename std::unordered_map< Pos, std::vector<T> >::iterator >::type
+					typename std::unordered_map< Pos, WorldListChunk<T,IndexKey> >::const_iterator,
+					typename std::unordered_map< Pos, WorldListChunk<T,IndexKey> >::iterator >::type
 					mapiter_t;
 				
 				vec_t curr_vec;
@@ -315,13 +461,13 @@ class WorldList : public std::unordered_map< Pos, std::vector<T> >
 		{
 			private:
 				friend class WorldList;
-				typedef typename std::conditional<is_const, const WorldList<T,EqualComparator>*, WorldList<T,EqualComparator>*>::type ptr_type;
+				typedef typename std::conditional<is_const, const WorldList<T,EqualComparator,IndexKey>*, WorldList<T,EqualComparator,IndexKey>*>::type ptr_type;
 				ptr_type parent;
 				Area_f area;
 				Range_(ptr_type parent_, Area_f area_) : parent(parent_), area(area_) {}
 			
 			public:
-				typedef WorldList<T,EqualComparator>::range_iterator<is_const, use_center> iterator;
+				typedef WorldList<T,EqualComparator,IndexKey>::range_iterator<is_const, use_center> iterator;
 
 				// allows to construct a ConstRange from a Range
 				Range_( const Range_<false, use_center>& other ) : parent(other.parent), area(other.area) {}
@@ -356,8 +502,8 @@ class WorldList : public std::unordered_map< Pos, std::vector<T> >
 			private:
 				typedef typename std::conditional<is_const, const T&, T&>::type reftype;
 				typedef typename std::conditional<is_const, const T*, T*>::type ptrtype;
-				typedef std::unordered_map<Pos, std::vector<T>> maptype;
-				typedef typename std::conditional<is_const, const WorldList<T,EqualComparator>*, WorldList<T,EqualComparator>*>::type parentptr;
+				typedef std::unordered_map<Pos, WorldListChunk<T,IndexKey>> maptype;
+				typedef typename std::conditional<is_const, const WorldList<T,EqualComparator,IndexKey>*, WorldList<T,EqualComparator,IndexKey>*>::type parentptr;
 
 				typedef typename std::conditional<is_const,
 					typename std::vector<T>::const_iterator,
@@ -564,13 +710,13 @@ class WorldList : public std::unordered_map< Pos, std::vector<T> >
 		{
 			private:
 				friend class WorldList;
-				typedef typename std::conditional<is_const, const WorldList<T,EqualComparator>*, WorldList<T,EqualComparator>*>::type ptr_type;
+				typedef typename std::conditional<is_const, const WorldList<T,EqualComparator,IndexKey>*, WorldList<T,EqualComparator,IndexKey>*>::type ptr_type;
 				ptr_type parent;
 				Pos_f center;
 				Around_(ptr_type parent_, Pos_f center_) : parent(parent_), center(center_) {}
 			
 			public:
-				typedef WorldList<T,EqualComparator>::around_iterator<is_const> iterator;
+				typedef WorldList<T,EqualComparator,IndexKey>::around_iterator<is_const> iterator;
 
 				// allows to construct a ConstAround from a Around
 				Around_( const Around_<false>& other ) : parent(other.parent), center(other.center) {}
@@ -608,13 +754,19 @@ class WorldList : public std::unordered_map< Pos, std::vector<T> >
 		/** inserts `thing` to the WorldList, copy */
 		void insert(const T& thing)
 		{
-			(*this)[Pos::tile_to_chunk(thing.get_pos().to_int_floor())].emplace_back(thing);
+			auto& chunk = (*this)[Pos::tile_to_chunk(thing.get_pos().to_int_floor())];
+			chunk.emplace_back(thing);
+			if constexpr (INDEXED)
+				chunk.appended();
 		}
 
 		/** inserts `thing` to the WorldList, move */
 		void insert(T&& thing)
 		{
-			(*this)[Pos::tile_to_chunk(thing.get_pos().to_int_floor())].emplace_back(std::move(thing));
+			auto& chunk = (*this)[Pos::tile_to_chunk(thing.get_pos().to_int_floor())];
+			chunk.emplace_back(std::move(thing));
+			if constexpr (INDEXED)
+				chunk.appended();
 		}
 
 		/** inserts all objects in the `things` container to the WorldList */
@@ -639,6 +791,9 @@ class WorldList : public std::unordered_map< Pos, std::vector<T> >
 			assert(iter.worklist_iterator->vector_ptr);
 			assert(iter.worklist_iterator->iterator_in_vector != iter.worklist_iterator->vector_ptr->end());
 
+			// this moves all following things, so the index is rebuilt on the next search
+			if constexpr (INDEXED)
+				static_cast<WorldListChunk<T,IndexKey>*>(iter.worklist_iterator->vector_ptr)->invalidate();
 			iter.worklist_iterator->vector_ptr->erase(iter.worklist_iterator->iterator_in_vector);
 		}
 
@@ -655,6 +810,9 @@ class WorldList : public std::unordered_map< Pos, std::vector<T> >
 			assert(!iter.curr_vec->empty());
 			assert(iter.iter != iter.curr_vec->end());
 
+			if constexpr (INDEXED)
+				static_cast<WorldListChunk<T,IndexKey>*>(iter.curr_vec)->erasing(iter.iter - iter.curr_vec->begin());
+
 			auto tmp = iter.iter;
 			if (++tmp == iter.curr_vec->end()) // we're erasing the last element of a vector
 			{
@@ -711,7 +869,25 @@ class WorldList : public std::unordered_map< Pos, std::vector<T> >
 			}
 		}
 
-		T& search(T what)
+		/** erases the thing that equals `what`, moving the last thing of its chunk into the gap.
+		  * Returns false if there is no such thing. Like erase(iter), this invalidates iterators
+		  * into that chunk. */
+		bool erase(const T& what)
+		{
+			T* thing = search_or_null(what);
+			if (!thing)
+				return false;
+
+			auto& chunk = (*this)[Pos::tile_to_chunk(what.get_pos().to_int_floor())];
+			if constexpr (INDEXED)
+				chunk.erasing(thing - chunk.data());
+			if (thing != &chunk.back())
+				*thing = std::move(chunk.back());
+			chunk.pop_back();
+			return true;
+		}
+
+		T& search(const T& what)
 		{
 			T* result = search_or_null(what);
 			if (result)
@@ -720,13 +896,18 @@ class WorldList : public std::unordered_map< Pos, std::vector<T> >
 				throw std::runtime_error("element not present");
 		}
 
-		T* search_or_null(T what)
+		T* search_or_null(const T& what)
 		{
-			EqualComparator comp;
 			auto& vec = (*this)[Pos::tile_to_chunk(what.get_pos().to_int_floor())];
-			for (auto& t : vec)
-				if (comp(t,what))
-					return &t;
-			return nullptr;
+			if constexpr (INDEXED)
+				return vec.template find<EqualComparator>(what);
+			else
+			{
+				EqualComparator comp;
+				for (auto& t : vec)
+					if (comp(t,what))
+						return &t;
+				return nullptr;
+			}
 		}
 };
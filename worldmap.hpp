@@ -56,7 +56,8 @@
 #include <vector>
 #include <type_traits>
 #include <stdexcept>
-#include <unordered_map>
+#include <memory>
+#include <cstdint>
 
 
 #include "pos.hpp"
@@ -80,6 +81,10 @@ class WorldMap
 
 				Pos origin;
 
+				// the last chunk that was accessed. Chunks never move, so this stays valid.
+				mutable chunktype cached_chunk = nullptr;
+				mutable Pos cached_chunkpos;
+
 				DumbViewport_(parenttype parent_, const Pos& origin_) : parent(parent_), origin(origin_) {}
 
 			public:
@@ -89,12 +94,20 @@ class WorldMap
 				{
 					int tilex = x+origin.x;
 					int tiley = y+origin.y;
-					int chunkx = chunkidx(tilex);
-					int chunky = chunkidx(tiley);
+					Pos chunkpos(chunkidx(tilex), chunkidx(tiley));
 					int relx = tileidx(tilex);
 					int rely = tileidx(tiley);
 
-					return (*parent->get_chunk(chunkx, chunky))[relx][rely];
+					if (cached_chunk == nullptr || chunkpos != cached_chunkpos)
+					{
+						chunktype chunk = parent->get_chunk(chunkpos.x, chunkpos.y);
+						if (chunk == &parent->dummy_chunk)
+							return (*chunk)[relx][rely]; // don't cache this, the chunk might be created later on
+						cached_chunk = chunk;
+						cached_chunkpos = chunkpos;
+					}
+
+					return (*cached_chunk)[relx][rely];
 				}
 
 				reftype at(const Pos& pos) const { return at(pos.x, pos.y); }
@@ -243,23 +256,35 @@ class WorldMap
 			return ConstDumbViewport(this, origin);
 		}
 
+		/** returns the chunk at chunk coordinates (x,y), creating it if necessary */
 		Chunk<T>* get_chunk(int x, int y)
 		{
-			Chunk<T>* retval = &(storage[ Pos(x,y) ]);
-			assert(retval != nullptr);
+			Pos pos(x,y);
+			if (last_chunk != nullptr && last_chunk_pos == pos)
+				return last_chunk;
+
+			Chunk<T>* retval = table.empty() ? nullptr : table[find_slot(pos)].chunk;
+			if (retval == nullptr)
+				retval = create_chunk(pos);
+
+			last_chunk = retval;
+			last_chunk_pos = pos;
 			return retval;
 		}
 		
+		/** returns the chunk at chunk coordinates (x,y), or an empty dummy chunk if it does not exist */
 		const Chunk<T>* get_chunk(int x, int y) const
 		{
-			try
-			{
-				return &(storage.at( Pos(x,y) ));
-			}
-			catch (const std::out_of_range&)
-			{
-				return &dummy_chunk;
-			}
+			const Chunk<T>* chunk = find_chunk(x,y);
+			return chunk != nullptr ? chunk : &dummy_chunk;
+		}
+
+		/** returns the chunk at chunk coordinates (x,y), or nullptr if it does not exist */
+		const Chunk<T>* find_chunk(int x, int y) const
+		{
+			if (table.empty())
+				return nullptr;
+			return table[find_slot(Pos(x,y))].chunk;
 		}
 		
 		const T& at(int x, int y) const
@@ -283,7 +308,64 @@ class WorldMap
 		const T& at(const Pos& pos) const { return at(pos.x, pos.y); }
 		T& at(const Pos& pos) { return at(pos.x, pos.y); }
 
+		/** calls func(chunk_pos, chunk) for every chunk that has been allocated, in no particular order */
+		template <typename Func> void for_each_chunk(Func func) const
+		{
+			for (const auto& [pos, chunk] : chunks)
+				func(pos, *chunk);
+		}
+		size_t n_chunks() const { return chunks.size(); }
+
 	private:
-		std::unordered_map< Pos, Chunk<T> > storage;
-		Chunk<T> dummy_chunk;
+		/** Chunks are looked up in an open addressing hash table with linear probing, whose
+		  * size is a power of two and which is kept at most half full. Chunks are never removed. */
+		struct slot_t
+		{
+			Pos pos;
+			Chunk<T>* chunk = nullptr; // nullptr means that the slot is empty
+		};
+		std::vector<slot_t> table;
+		std::vector< std::pair< Pos, std::unique_ptr< Chunk<T> > > > chunks; // owns the chunks, so that they never move
+		Chunk<T>* last_chunk = nullptr; // one-entry cache for the non-const get_chunk()
+		Pos last_chunk_pos;
+		Chunk<T> dummy_chunk{}; // returned for chunks that do not exist. value-initialized, so that this is also empty for plain types
+
+		static size_t hash(const Pos& pos)
+		{
+			// the splitmix64 finalizer. Chunk coordinates are small and clustered around the
+			// origin, so the bits need to be mixed well before taking only the lowest ones.
+			uint64_t h = (uint64_t(uint32_t(pos.x)) << 32) | uint32_t(pos.y);
+			h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+			h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+			return size_t(h ^ (h >> 31));
+		}
+
+		/** returns the slot containing `pos`, or the empty slot where it would be inserted */
+		size_t find_slot(const Pos& pos) const
+		{
+			size_t mask = table.size() - 1;
+			for (size_t i = hash(pos) & mask; ; i = (i+1) & mask)
+				if (table[i].chunk == nullptr || table[i].pos == pos)
+					return i;
+		}
+
+		/** makes space for another chunk, and returns the empty slot for `pos` */
+		slot_t& insert_slot(const Pos& pos)
+		{
+			if (2*(chunks.size()+1) > table.size())
+			{
+				table.assign(std::max(size_t(64), 2*table.size()), slot_t());
+				for (auto& [chunkpos, chunk] : chunks)
+					table[find_slot(chunkpos)] = slot_t{chunkpos, chunk.get()};
+			}
+			return table[find_slot(pos)];
+		}
+
+		Chunk<T>* create_chunk(const Pos& pos)
+		{
+			slot_t& slot = insert_slot(pos);
+			chunks.emplace_back(pos, std::make_unique< Chunk<T> >());
+			slot = slot_t{pos, chunks.back().second.get()};
+			return slot.chunk;
+		}
 };